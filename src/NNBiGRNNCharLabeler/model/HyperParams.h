@@ -4,6 +4,7 @@
 #include "N3L.h"
 #include "Example.h"
 #include "Options.h"
+#include "ModelFile.h"
 
 using namespace nr;
 using namespace std;
@@ -25,6 +26,8 @@ struct HyperParams{
 	int wordWindowOutput;
 	int charWindowOutput;
 	dtype dropProb;
+	bool parallelBranches; // char branch on its own thread
+	bool hoistRNN; // input projections of all steps in one GEMM
 
 
 	//auto generated
@@ -36,6 +39,8 @@ struct HyperParams{
 public:
 	HyperParams(){
 		bAssigned = false;
+		parallelBranches = false;
+		hoistRNN = true;
 	}
 
 public:
@@ -48,10 +53,17 @@ public:
 		wordContext = opt.wordcontext;
 		charContext = opt.charcontext;
 		dropProb = opt.dropProb;
+		setRuntime(opt);
 
 		bAssigned = true;
 	}
 
+	// execution flags, taken from the options of every run and not stored with the model
+	void setRuntime(Options& opt){
+		parallelBranches = opt.parallelBranches;
+		hoistRNN = opt.hoistRNN;
+	}
+
 	void clear(){
 		bAssigned = false;
 	}
@@ -61,51 +73,52 @@ public:
 	}
 
 
-	void saveModel(std::ofstream &os) const{
-		os << nnRegular << endl; 
-		os << adaAlpha << endl; 
-		os << adaEps << endl; 
+	void saveModel(ModelWriter& writer) const {
+		writer.write(nnRegular);
+		writer.write(adaAlpha);
+		writer.write(adaEps);
 
-		os << rnnHiddenSize << endl;
-		os << wordContext << endl;
-		os << wordWindow << endl;
+		writer.write(rnnHiddenSize);
+		writer.write(wordContext);
+		writer.write(wordWindow);
 
-		os << charHiddenSize << endl;
-		os << charContext << endl;
-		os << charWindow << endl;
+		writer.write(charHiddenSize);
+		writer.write(charContext);
+		writer.write(charWindow);
 
-		os << wordWindowOutput << endl;
-		os << charWindowOutput << endl;
-		os << dropProb << endl;
+		writer.write(wordWindowOutput);
+		writer.write(charWindowOutput);
+		writer.write(dropProb);
 
-		os << wordDim << endl;
-		os << charDim << endl;
-		os << inputSize << endl;
-		os << labelSize << endl;
+		writer.write(wordDim);
+		writer.write(charDim);
+		writer.write(inputSize);
+		writer.write(labelSize);
 	}
 
-	void loadModel(std::ifstream &is){
-		is >> nnRegular; 
-		is >> adaAlpha; 
-		is >> adaEps; 
+	void loadModel(ModelReader& reader) {
+		reader.read(nnRegular);
+		reader.read(adaAlpha);
+		reader.read(adaEps);
 
-		is >> rnnHiddenSize;
-		is >> wordContext;
-		is >> wordWindow;
+		reader.read(rnnHiddenSize);
+		reader.read(wordContext);
+		reader.read(wordWindow);
 
-		is >> charHiddenSize;
-		is >> charContext;
-		is >> charWindow;
+		reader.read(charHiddenSize);
+		reader.read(charContext);
+		reader.read(charWindow);
 
-		is >> wordWindowOutput;
-		is >> charWindowOutput;
-		is >> dropProb;
+		reader.read(wordWindowOutput);
+		reader.read(charWindowOutput);
+		reader.read(dropProb);
 
-		is >> wordDim;
-		is >> charDim;
-		is >> inputSize;
-		is >> labelSize;
-		bAssigned = true;
+		reader.read(wordDim);
+		reader.read(charDim);
+		reader.read(inputSize);
+		reader.read(labelSize);
+
+		bAssigned = reader.good();
 	}
 public:
 
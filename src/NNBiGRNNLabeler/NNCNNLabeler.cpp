@@ -1,4 +1,5 @@
 #include "NNCNNLabeler.h"
+#include <chrono>
 
 #include "Argument_helper.h"
 
@@ -18,27 +19,17 @@ int Classifier::createAlphabet(const vector<Instance>& vecInsts) {
 	}
 	cout << "Creating Alphabet..." << endl;
 
-	int numInstance;
+	int numInstance = vecInsts.size();
+	// the serial loop stopped after the instance numbered maxInstance
+	if (m_options.maxInstance > 0 && m_options.maxInstance < numInstance)
+		numInstance = m_options.maxInstance + 1;
 
 	m_driver._modelparams.labelAlpha.clear();
 
-	for (numInstance = 0; numInstance < vecInsts.size(); numInstance++) {
-		const Instance *pInstance = &vecInsts[numInstance];
-
-		const vector<string> &words = pInstance->m_tweet;
-		const string &label = pInstance->m_label;
-
-		m_driver._modelparams.labelAlpha.from_string(label);
-		int words_num = words.size();
-		for (int i = 0; i < words_num; i++)
-		{
-			string curword = normalize_to_lowerwithdigit(words[i]);
-			m_word_stats[curword]++;
-		}
-
-		if (m_options.maxInstance > 0 && numInstance == m_options.maxInstance)
-			break;
-	}
+	vector<string> labels;
+	AlphabetBuilder(m_options.threads).count(vecInsts, numInstance, &m_word_stats, NULL, &labels);
+	for (int idx = 0; idx < labels.size(); idx++)
+		m_driver._modelparams.labelAlpha.from_string(labels[idx]);
 
 	cout << numInstance << " " << endl;
 	cout << "Label num: " << m_driver._modelparams.labelAlpha.size() << endl;
@@ -50,20 +41,12 @@ int Classifier::createAlphabet(const vector<Instance>& vecInsts) {
 int Classifier::addTestAlpha(const vector<Instance>& vecInsts) {
 	cout << "Adding word Alphabet..." << endl;
 
+	int numInstance = vecInsts.size();
+	if (m_options.maxInstance > 0 && m_options.maxInstance < numInstance)
+		numInstance = m_options.maxInstance + 1;
 
-	for (int numInstance = 0; numInstance < vecInsts.size(); numInstance++) {
-		const Instance *pInstance = &vecInsts[numInstance];
-
-		const vector<string> &words = pInstance->m_tweet;
-		int curInstSize = words.size();
-		for (int i = 0; i < curInstSize; ++i) {
-			string curword = normalize_to_lowerwithdigit(words[i]);
-			if (!m_options.wordEmbFineTune)m_word_stats[curword]++;
-		}
-
-		if (m_options.maxInstance > 0 && numInstance == m_options.maxInstance)
-			break;
-	}
+	AlphabetBuilder(m_options.threads).count(vecInsts, numInstance,
+		m_options.wordEmbFineTune ? NULL : &m_word_stats, NULL, NULL);
 
 	return 0;
 }
@@ -76,18 +59,8 @@ void Classifier::extractFeature(Feature& feat, const Instance* pInstance) {
 
 void Classifier::convert2Example(const Instance* pInstance, Example& exam) {
 	exam.clear();
-	const string &orcale = pInstance->m_label;
-	int numLabel = m_driver._modelparams.labelAlpha.size();
-	vector<dtype> curlabels;
-	for (int j = 0; j < numLabel; ++j) {
-		string str = m_driver._modelparams.labelAlpha.from_id(j);
-		if (str.compare(orcale) == 0)
-			curlabels.push_back(1.0);
-		else
-			curlabels.push_back(0.0);
-	}
-
-	exam.m_label = curlabels;
+	// labelAlpha is fixed, a label it does not know becomes -1
+	exam.m_label = m_driver._modelparams.labelAlpha.from_string(pInstance->m_label);
 	Feature feat;
 	extractFeature(feat, pInstance);
 	exam.m_feature = feat;
@@ -114,10 +87,23 @@ void Classifier::initialExamples(const vector<Instance>& vecInsts, vector<Exampl
 	cout << numInstance << " " << endl;
 }
 
+void Classifier::initialIds(vector<Example>& vecExams) {
+	for (int idx = 0; idx < vecExams.size(); idx++) {
+		Feature& feat = vecExams[idx].m_feature;
+		feat.m_ids.resize(feat.m_tweet_words.size());
+		int offset = 0;
+		for (int i = 0; i < feat.m_tweet_words.size(); i++, offset++)
+			feat.m_ids[offset] = m_driver._modelparams.words.getElemId(feat.m_tweet_words[i]);
+		feat.m_char_offset = offset;
+		vector<string>().swap(feat.m_tweet_words);
+	}
+}
+
 void Classifier::train(const string& trainFile, const string& devFile, const string& testFile, const string& modelFile, const string& optionFile) {
 	if (optionFile != "")
 		m_options.load(optionFile);
 	m_options.showOptions();
+	m_pipe.threads = m_options.threads;
 	vector<Instance> trainInsts, devInsts, testInsts;
 	static vector<Instance> decodeInstResults;
 	static Instance curDecodeInst;
@@ -162,151 +148,191 @@ void Classifier::train(const string& trainFile, const string& devFile, const str
 	m_word_stats[unknownkey] = m_options.wordCutOff + 1;
 	m_driver._modelparams.wordAlpha.initial(m_word_stats, m_options.wordCutOff);
 	if (m_options.wordFile != "") {
-		m_driver._modelparams.words.initial(&m_driver._modelparams.wordAlpha, m_options.wordFile, m_options.wordEmbFineTune);
+		EmbeddingLoader(m_options.threads).load(m_driver._modelparams.words, &m_driver._modelparams.wordAlpha, m_options.wordFile, m_options.wordEmbFineTune);
 	}
 	else{
 		m_driver._modelparams.words.initial(&m_driver._modelparams.wordAlpha, m_options.wordEmbSize, m_options.wordEmbFineTune);
 	}
 
-	m_driver._hyperparams.setRequared(m_options);
-	m_driver.initial();
+	initialIds(trainExamples);
+	initialIds(devExamples);
+	initialIds(testExamples);
+	for (int idx = 0; idx < otherExamples.size(); idx++) {
+		initialIds(otherExamples[idx]);
+	}
 
+	// the longest sentences size the graphs m_driver.initial() creates
+	m_driver._memory.addCorpus(trainExamples);
+	m_driver._memory.addCorpus(devExamples);
+	m_driver._memory.addCorpus(testExamples);
+	for (int idx = 0; idx < otherExamples.size(); idx++) {
+		m_driver._memory.addCorpus(otherExamples[idx]);
+	}
 
-	dtype bestDIS = 0;
+	m_driver._hyperparams.setRequared(m_options);
+	m_driver.initial(m_options.threads);
 
-	int inputSize = trainExamples.size();
 
-	int batchBlock = inputSize / m_options.batchSize;
-	if (inputSize % m_options.batchSize != 0)
-		batchBlock++;
+	dtype bestDIS = 0;
 
 	srand(0);
-	std::vector<int> indexes;
-	for (int i = 0; i < inputSize; ++i)
-		indexes.push_back(i);
+	BucketSampler sampler;
+	sampler.initial(trainExamples, m_options.batchSize, m_options.bucketWidth, false);
+	int batchBlock = sampler.batchNum();
+	std::vector<std::vector<int> > batches;
 
 	static Metric eval, metric_dev, metric_test;
-	static vector<Example> subExamples;
+	static vector<const Example*> subExamples;
 	int devNum = devExamples.size(), testNum = testExamples.size();
-	for (int iter = 0; iter < m_options.maxIter; ++iter) {
-		std::cout << "##### Iteration " << iter << std::endl;
 
-		random_shuffle(indexes.begin(), indexes.end());
-		eval.reset();
-		for (int updateIter = 0; updateIter < batchBlock; updateIter++) {
-			subExamples.clear();
-			int start_pos = updateIter * m_options.batchSize;
-			int end_pos = (updateIter + 1) * m_options.batchSize;
-			if (end_pos > inputSize)
-				end_pos = inputSize;
+	// dev, test and testFiles examples in this order, predicted together after each iteration
+	vector<const Example*> evalExamples;
+	vector<string> evalResults;
+	for (int idx = 0; idx < devNum; idx++)
+		evalExamples.push_back(&devExamples[idx]);
+	for (int idx = 0; idx < testNum; idx++)
+		evalExamples.push_back(&testExamples[idx]);
+	for (int idx = 0; idx < otherExamples.size(); idx++) {
+		for (int idy = 0; idy < otherExamples[idx].size(); idy++)
+			evalExamples.push_back(&otherExamples[idx][idy]);
+	}
 
-			for (int idy = start_pos; idy < end_pos; idy++) {
-				subExamples.push_back(trainExamples[indexes[idy]]);
-			}
+	vector<int> evalLabelIdxs;
 
-			int curUpdateIter = iter * batchBlock + updateIter;
-			dtype cost = m_driver.train(subExamples, curUpdateIter);
+	// metrics, outBest files and the best model from the predictions of evalExamples by params
+	auto report = [&](const ModelParams& params) {
+		bCurIterBetter = false;
+		if (!m_options.outBest.empty())
+			decodeInstResults.clear();
+		metric_dev.reset();
+		for (int idx = 0; idx < devExamples.size(); idx++) {
+			const string& result_label = evalResults[idx];
 
-			eval.overall_label_count += m_driver._eval.overall_label_count;
-			eval.correct_label_count += m_driver._eval.correct_label_count;
+			devInsts[idx].evaluate(result_label, metric_dev);
 
-			if ((curUpdateIter + 1) % m_options.verboseIter == 0) {
-				//m_driver.checkgrad(subExamples, curUpdateIter + 1);
-				std::cout << "current: " << updateIter + 1 << ", total block: " << batchBlock << std::endl;
-				std::cout << "Cost = " << cost << ", Tag Correct(%) = " << eval.getAccuracy() << std::endl;
+			if (!m_options.outBest.empty()) {
+				curDecodeInst.copyValuesFrom(devInsts[idx]);
+				curDecodeInst.assignLabel(result_label);
+				decodeInstResults.push_back(curDecodeInst);
 			}
-			m_driver.updateModel();
+		}
 
+		std::cout << "dev:" << std::endl;
+		metric_dev.print();
+
+		if (!m_options.outBest.empty() && metric_dev.getAccuracy() > bestDIS) {
+			m_pipe.outputAllInstances(devFile + m_options.outBest, decodeInstResults);
+			bCurIterBetter = true;
 		}
 
-		if (devNum > 0) {
-			clock_t time_start = clock();
-			bCurIterBetter = false;
+		if (testNum > 0) {
 			if (!m_options.outBest.empty())
 				decodeInstResults.clear();
-			metric_dev.reset();
-			for (int idx = 0; idx < devExamples.size(); idx++) {
-				string result_label;
-				predict(devExamples[idx].m_feature, result_label);
+			metric_test.reset();
+			for (int idx = 0; idx < testExamples.size(); idx++) {
+				const string& result_label = evalResults[devNum + idx];
 
-				devInsts[idx].evaluate(result_label, metric_dev);
+				testInsts[idx].evaluate(result_label, metric_test);
 
-				if (!m_options.outBest.empty()) {
-					curDecodeInst.copyValuesFrom(devInsts[idx]);
+				if (bCurIterBetter && !m_options.outBest.empty()) {
+					curDecodeInst.copyValuesFrom(testInsts[idx]);
 					curDecodeInst.assignLabel(result_label);
 					decodeInstResults.push_back(curDecodeInst);
 				}
 			}
+			std::cout << "test:" << std::endl;
+			metric_test.print();
 
-			std::cout << "Dev finished. Total time taken is: " << double(clock() - time_start) / CLOCKS_PER_SEC << std::endl;
-			std::cout << "dev:" << std::endl;
-			metric_dev.print();
-
-			if (!m_options.outBest.empty() && metric_dev.getAccuracy() > bestDIS) {
-				m_pipe.outputAllInstances(devFile + m_options.outBest, decodeInstResults);
-				bCurIterBetter = true;
+			if (!m_options.outBest.empty() && bCurIterBetter) {
+				m_pipe.outputAllInstances(testFile + m_options.outBest, decodeInstResults);
 			}
+		}
 
-			if (testNum > 0) {
-				time_start = clock();
-				if (!m_options.outBest.empty())
-					decodeInstResults.clear();
-				metric_test.reset();
-				for (int idx = 0; idx < testExamples.size(); idx++) {
-					string result_label;
-					predict(testExamples[idx].m_feature, result_label);
-
-					testInsts[idx].evaluate(result_label, metric_test);
-
-					if (bCurIterBetter && !m_options.outBest.empty()) {
-						curDecodeInst.copyValuesFrom(testInsts[idx]);
-						curDecodeInst.assignLabel(result_label);
-						decodeInstResults.push_back(curDecodeInst);
-					}
-				}
-				std::cout << "Test finished. Total time taken is: " << double(clock() - time_start) / CLOCKS_PER_SEC << std::endl;
-				std::cout << "test:" << std::endl;
-				metric_test.print();
+		int offset = devNum + testNum;
+		for (int idx = 0; idx < otherExamples.size(); idx++) {
+			std::cout << "processing " << m_options.testFiles[idx] << std::endl;
+			if (!m_options.outBest.empty())
+				decodeInstResults.clear();
+			metric_test.reset();
+			for (int idy = 0; idy < otherExamples[idx].size(); idy++) {
+				const string& result_label = evalResults[offset + idy];
 
-				if (!m_options.outBest.empty() && bCurIterBetter) {
-					m_pipe.outputAllInstances(testFile + m_options.outBest, decodeInstResults);
+				otherInsts[idx][idy].evaluate(result_label, metric_test);
+
+				if (bCurIterBetter && !m_options.outBest.empty()) {
+					curDecodeInst.copyValuesFrom(otherInsts[idx][idy]);
+					curDecodeInst.assignLabel(result_label);
+					decodeInstResults.push_back(curDecodeInst);
 				}
 			}
+			std::cout << "test:" << std::endl;
+			metric_test.print();
 
-			for (int idx = 0; idx < otherExamples.size(); idx++) {
-				std::cout << "processing " << m_options.testFiles[idx] << std::endl;
-				if (!m_options.outBest.empty())
-					decodeInstResults.clear();
-				metric_test.reset();
-				for (int idy = 0; idy < otherExamples[idx].size(); idy++) {
-					string result_label;
-					predict(otherExamples[idx][idy].m_feature, result_label);
-
-					otherInsts[idx][idy].evaluate(result_label, metric_test);
-
-					if (bCurIterBetter && !m_options.outBest.empty()) {
-						curDecodeInst.copyValuesFrom(otherInsts[idx][idy]);
-						curDecodeInst.assignLabel(result_label);
-						decodeInstResults.push_back(curDecodeInst);
-					}
-				}
-				std::cout << "test:" << std::endl;
-				metric_test.print();
+			if (!m_options.outBest.empty() && bCurIterBetter) {
+				m_pipe.outputAllInstances(m_options.testFiles[idx] + m_options.outBest, decodeInstResults);
+			}
+			offset += otherExamples[idx].size();
+		}
 
-				if (!m_options.outBest.empty() && bCurIterBetter) {
-					m_pipe.outputAllInstances(m_options.testFiles[idx] + m_options.outBest, decodeInstResults);
-				}
+		if (m_options.saveIntermediate && metric_dev.getAccuracy() > bestDIS) {
+			std::cout << "Exceeds best previous performance of " << bestDIS << ". Saving model file.." << std::endl;
+			bestDIS = metric_dev.getAccuracy();
+			writeModelFile(modelFile, params);
+		}
+	};
+
+	if (m_options.asyncEval)
+		m_driver.initialSnapshot(m_options.threads);
+
+	for (int iter = 0; iter < m_options.maxIter; ++iter) {
+		std::cout << "##### Iteration " << iter << std::endl;
+
+		sampler.sample(batches);
+		eval.reset();
+		for (int updateIter = 0; updateIter < batchBlock; updateIter++) {
+			subExamples.clear();
+			for (int idy = 0; idy < batches[updateIter].size(); idy++) {
+				subExamples.push_back(&trainExamples[batches[updateIter][idy]]);
 			}
 
-			if (m_options.saveIntermediate && metric_dev.getAccuracy() > bestDIS) {
-				std::cout << "Exceeds best previous performance of " << bestDIS << ". Saving model file.." << std::endl;
-				bestDIS = metric_dev.getAccuracy();
-				writeModelFile(modelFile);
+			int curUpdateIter = iter * batchBlock + updateIter;
+			dtype cost = m_driver.train(subExamples, curUpdateIter);
+
+			eval.overall_label_count += m_driver._eval.overall_label_count;
+			eval.correct_label_count += m_driver._eval.correct_label_count;
+
+			if ((curUpdateIter + 1) % m_options.verboseIter == 0) {
+				//m_driver.checkgrad(subExamples, curUpdateIter + 1);
+				std::cout << "current: " << updateIter + 1 << ", total block: " << batchBlock << std::endl;
+				std::cout << "Cost = " << cost << ", Tag Correct(%) = " << eval.getAccuracy() << std::endl;
 			}
+			m_driver.updateModel();
 
 		}
+		std::cout << "Padding efficiency(%) = " << sampler.efficiency(batches) * 100 << std::endl;
+
+		if (devNum > 0) {
+			chrono::steady_clock::time_point time_start = chrono::steady_clock::now();
+			if (m_options.asyncEval) {
+				// training goes on while the snapshot of this iteration is evaluated
+				m_driver.takeSnapshot();
+				m_driver.predictSnapshot(evalExamples, evalLabelIdxs, [&, iter, time_start]() {
+					std::cout << "##### Evaluation of iteration " << iter << std::endl;
+					std::cout << "Evaluation finished. Total time taken is: " << chrono::duration<double>(chrono::steady_clock::now() - time_start).count() << std::endl;
+					assignLabels(evalLabelIdxs, evalResults);
+					report(m_driver._snapshot_params);
+				});
+			}
+			else {
+				predict(evalExamples, evalResults);
+				std::cout << "Evaluation finished. Total time taken is: " << chrono::duration<double>(chrono::steady_clock::now() - time_start).count() << std::endl;
+				report(m_driver._modelparams);
+			}
+		}
 		// Clear gradients
 	}
+	m_driver.waitSnapshot();
+	m_driver._memory.printPeak("train");
 }
 
 int Classifier::predict(const Feature& feature, string& output) {
@@ -321,53 +347,150 @@ int Classifier::predict(const Feature& feature, string& output) {
 	return 0;
 }
 
-void Classifier::test(const string& testFile, const string& outputFile, const string& modelFile) {
-	loadModelFile(modelFile);
-	m_driver.TestInitial();
-	vector<Instance> testInsts;
-	m_pipe.readInstances(testFile, testInsts);
+void Classifier::predict(const vector<const Example*>& examples, vector<string>& outputs) {
+	vector<int> labelIdxs;
+	m_driver.predict(examples, labelIdxs);
+	assignLabels(labelIdxs, outputs);
+}
 
-	vector<Example> testExamples;
-	initialExamples(testInsts, testExamples);
+void Classifier::assignLabels(const vector<int>& labelIdxs, vector<string>& outputs) {
+	outputs.resize(labelIdxs.size());
+	for (int idx = 0; idx < labelIdxs.size(); idx++) {
+		outputs[idx] = m_driver._modelparams.labelAlpha.from_id(labelIdxs[idx], unknownkey);
+		if (outputs[idx] == nullkey){
+			std::cout << "predict error" << std::endl;
+		}
+	}
+}
+
+void Classifier::test(const string& testFile, const string& outputFile, const string& modelFile, const string& optionFile) {
+	if (optionFile != "")
+		m_options.load(optionFile);
+	loadModelFile(modelFile);
+	m_driver.TestInitial(m_options.threads);
+	CorpusReader reader;
+	if (!reader.open(testFile) || m_pipe.initOutputFile(outputFile.c_str()) != 0)
+		return;
 
-	int testNum = testExamples.size();
-	vector<Instance> testInstResults;
+	// read, decoded by a graph per thread and written in order, a block of instances at a time
 	Metric metric_test;
 	metric_test.reset();
-	for (int idx = 0; idx < testExamples.size(); idx++) {
-		string result_label;
-		predict(testExamples[idx].m_feature, result_label);
-		testInsts[idx].evaluate(result_label, metric_test);
-		Instance curResultInst;
-		curResultInst.copyValuesFrom(testInsts[idx]);
-		curResultInst.assignLabel(result_label);
-		testInstResults.push_back(curResultInst);
-	}
+	StreamDecoder decoder(m_driver._pcgs.size());
+	int testNum = decoder.run([&reader](Instance& inst) {
+		return reader.next(inst);
+	}, [this](int worker, const vector<Instance>& insts, vector<string>& labels) {
+		vector<Example> examples(insts.size());
+		vector<const Example*> pExamples(insts.size());
+		for (int idx = 0; idx < insts.size(); idx++) {
+			convert2Example(&insts[idx], examples[idx]);
+			pExamples[idx] = &examples[idx];
+		}
+		initialIds(examples);
+		vector<int> labelIdxs;
+		m_driver.predict(pExamples, labelIdxs, worker);
+		assignLabels(labelIdxs, labels);
+	}, [&](vector<Instance>& insts, const vector<string>& labels) {
+		for (int idx = 0; idx < insts.size(); idx++) {
+			insts[idx].evaluate(labels[idx], metric_test);
+			insts[idx].assignLabel(labels[idx]);
+			m_pipe.outputSingleInstance(insts[idx]);
+		}
+	});
+	reader.close();
+	m_pipe.uninitOutputFile();
+
+	std::cout << "instance num: " << testNum << std::endl;
 	std::cout << "test:" << std::endl;
 	metric_test.print();
+	m_driver._memory.printPeak("test");
+}
 
-	m_pipe.outputAllInstances(outputFile, testInstResults);
 
+void Classifier::serve(const string& modelFile, const string& optionFile, const string& socketFile) {
+	// stdout carries the responses without a socket, the log goes to stderr then
+	streambuf* log = cout.rdbuf();
+	if (socketFile == "")
+		cout.rdbuf(cerr.rdbuf());
+	if (optionFile != "")
+		m_options.load(optionFile);
+	m_options.showOptions();
+	loadModelFile(modelFile);
+	m_driver.TestInitial(m_options.threads);
+
+	InferenceServer server(m_options.serveBatch, m_options.serveWait);
+	if (!server.serve(socketFile, [this](const vector<string>& requests, vector<string>& responses) {
+		serveBatch(requests, responses);
+	}))
+		cout << "serve error" << endl;
+	cout.rdbuf(log);
+}
+
+// a request is the text of an instance, or a corpus line whose label is ignored.
+// the response is the predicted label followed by every label and its probability,
+// tab separated, and empty for a request without words.
+void Classifier::serveBatch(const vector<string>& requests, vector<string>& responses) {
+	vector<Instance> insts(requests.size());
+	vector<string> fields;
+	for (int idx = 0; idx < requests.size(); idx++) {
+		split_bychars(requests[idx], fields, "\t");
+		if (!fields.empty())
+			split_bychars(fields.size() > 1 ? fields[1] : fields[0], insts[idx].m_tweet, " ");
+	}
+
+	vector<Example> examples(insts.size());
+	for (int idx = 0; idx < insts.size(); idx++)
+		convert2Example(&insts[idx], examples[idx]);
+	initialIds(examples);
+	vector<const Example*> pExamples;
+	for (int idx = 0; idx < examples.size(); idx++) {
+		if (!insts[idx].m_tweet.empty())
+			pExamples.push_back(&examples[idx]);
+	}
+
+	vector<int> labelIdxs;
+	vector<dtype> probs;
+	vector<string> labels;
+	m_driver.predict(pExamples, labelIdxs, probs);
+	assignLabels(labelIdxs, labels);
+
+	const Alphabet& labelAlpha = m_driver._modelparams.labelAlpha;
+	int labelNum = labelAlpha.size();
+	responses.assign(requests.size(), "");
+	for (int idx = 0, count = 0; idx < insts.size(); idx++) {
+		if (insts[idx].m_tweet.empty())
+			continue;
+		ostringstream response;
+		response << labels[count];
+		for (int label = 0; label < labelNum; label++)
+			response << "\t" << labelAlpha.from_id(label) << " " << probs[count * labelNum + label];
+		responses[idx] = response.str();
+		count++;
+	}
 }
 
 
 void Classifier::loadModelFile(const string& inputModelFile) {
-	ifstream is(inputModelFile);
-	if (is.is_open()) {
-		m_driver._hyperparams.loadModel(is);
-		m_driver._modelparams.loadModel(is, &m_driver._aligned_mem);
-		is.close();
+	ModelReader& reader = m_driver._model_file;
+	if (reader.open(inputModelFile, "NNBiGRNNLabeler")) {
+		m_driver._hyperparams.loadModel(reader);
+		m_driver._hyperparams.setRuntime(m_options);
+		if (!m_driver._modelparams.loadModel(reader, m_driver._hyperparams, &m_driver._aligned_mem))
+			cout << "load model error" << endl;
 	}
 	else
 		cout << "load model error" << endl;
 }
 
 void Classifier::writeModelFile(const string& outputModelFile) {
-	ofstream os(outputModelFile);
-	if (os.is_open()) {
-		m_driver._hyperparams.saveModel(os);
-		m_driver._modelparams.saveModel(os);
-		os.close();
+	writeModelFile(outputModelFile, m_driver._modelparams);
+}
+
+void Classifier::writeModelFile(const string& outputModelFile, const ModelParams& params) {
+	ModelWriter writer;
+	if (writer.open(outputModelFile, "NNBiGRNNLabeler")) {
+		m_driver._hyperparams.saveModel(writer);
+		params.saveModel(writer);
+		writer.close();
 		cout << "write model ok. " << endl;
 	}
 	else
@@ -375,23 +498,28 @@ void Classifier::writeModelFile(const string& outputModelFile) {
 }
 
 
+#ifndef N3L_LIBRARY
 int main(int argc, char* argv[]) {
 
 	std::string trainFile = "", devFile = "", testFile = "", modelFile = "", optionFile = "";
 	std::string outputFile = "";
 	bool bTrain = false;
+	bool bServe = false;
+	std::string socketFile = "";
 	int memsize = 0;
  	dsr::Argument_helper ah;
 
 	ah.new_flag("l", "learn", "train or test", bTrain);
+	ah.new_flag("s", "serve", "serve requests with a trained model", bServe);
 	ah.new_named_string("train", "trainCorpus", "named_string", "training corpus to train a model, must when training", trainFile);
 	ah.new_named_string("dev", "devCorpus", "named_string", "development corpus to train a model, optional when training", devFile);
 	ah.new_named_string("test", "testCorpus", "named_string",
 		"testing corpus to train a model or input file to test a model, optional when training and must when testing", testFile);
 	ah.new_named_string("model", "modelFile", "named_string", "model file, must when training and testing", modelFile);
-	ah.new_named_string("option", "optionFile", "named_string", "option file to train a model, optional when training", optionFile);
+	ah.new_named_string("option", "optionFile", "named_string", "option file to train a model, optional when training, testing and serving", optionFile);
 	ah.new_named_string("output", "outputFile", "named_string", "output file to test, must when testing", outputFile);
-	ah.new_named_int("memsize", "memorySize", "named_int", "This argument decides the size of static memory allocation", memsize);
+	ah.new_named_string("socket", "socketFile", "named_string", "unix domain socket to serve on, stdin and stdout if not given", socketFile);
+	ah.new_named_int("memsize", "memorySize", "named_int", "size of the static memory pool, 0 allocates every tensor on the heap at its own size; the sizes needed are reported after initialization", memsize);
 
 	ah.process(argc, argv);
 
@@ -401,10 +529,14 @@ int main(int argc, char* argv[]) {
 	if (bTrain) {
 		the_classifier.train(trainFile, devFile, testFile, modelFile, optionFile);
 	}
+	else if (bServe) {
+		the_classifier.serve(modelFile, optionFile, socketFile);
+	}
 	else {
-		the_classifier.test(testFile, outputFile, modelFile);
+		the_classifier.test(testFile, outputFile, modelFile, optionFile);
 	}
 	//getchar();
 	//test(argv);
 	//ah.write_values(std::cout);
 }
+#endif
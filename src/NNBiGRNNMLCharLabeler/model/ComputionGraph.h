@@ -2,6 +2,9 @@
 #define SRC_ComputionGraph_H_
 
 #include "ModelParams.h"
+#include "IdLookupNode.h"
+#include "ParallelBranch.h"
+#include "HoistedRecurrent.h"
 
 
 // Each model consists of two parts, building neural graph and defining output losses.
@@ -9,37 +12,51 @@ struct ComputionGraph : Graph{
 public:
 	const static int max_sentence_length = 2048;
 	const static int max_char_length = 4096;
+	// the nodes first created without corpus lengths, reserve() grows them up to the max lengths on demand
+	const static int initial_sentence_length = 64;
+	const static int initial_char_length = 256;
 	int rnn_layer_size;
 
 public:
 	// node instances
-	vector<LookupNode> _word_inputs;
-	WindowBuilder _word_window;
+	vector<IdLookupNode> _word_inputs;
+	WindowSeqNode _word_window;
 
-	vector<GRNNBuilder> _rnn_lefts;
-	vector<GRNNBuilder> _rnn_rights;
+	vector<HoistedGRNNBuilder> _rnn_lefts;
+	vector<HoistedGRNNBuilder> _rnn_rights;
+	vector<BiRecurrentNode<HoistedGRNNBuilder> > _bi_rnns;
+	ThreadPool _direction_pool; // the left-to-right half of every _bi_rnns node
 
-	vector<vector<ConcatNode> > _rnn_concats;
+	vector<ConcatSeqNode> _rnn_concats;
 
-	AvgPoolNode _avg_word_pooling;
-	MaxPoolNode _max_word_pooling;
-	MinPoolNode _min_word_pooling;
+	PoolingSeqNode _word_pooling;
 
-	ConcatNode _word_pooling_concat;
+	vector<IdLookupNode> _char_inputs;
+	WindowSeqNode _char_window;
+	UniSeqNode _char_hidden;
 
-	vector<LookupNode> _char_inputs;
-	WindowBuilder _char_window;
-	vector<UniNode> _char_hidden;
-
-	AvgPoolNode _avg_char_pooling;
-	MaxPoolNode _max_char_pooling;
-	MinPoolNode _min_char_pooling;
-	ConcatNode _char_pooling_concat;
+	PoolingSeqNode _char_pooling;
+	ParallelBranch _char_branch;
 
 	ConcatNode _concat;
 	LinearNode _output;
+
+	// the lengths the nodes are created for, and what reserve() creates them again with
+	int _sent_capacity;
+	int _char_capacity;
+	ModelParams* _model;
+	HyperParams* _opts;
+	AlignedMemoryPool* _mem;
+	// a graph that only decodes, whose nodes keep no backward state
+	bool _inference;
 public:
 	ComputionGraph() : Graph(){
+		_sent_capacity = 0;
+		_char_capacity = 0;
+		_model = NULL;
+		_opts = NULL;
+		_mem = NULL;
+		_inference = false;
 	}
 
 	~ComputionGraph(){
@@ -49,72 +66,82 @@ public:
 public:
 	//allocate enough nodes 
 	inline void createNodes(int sent_length, int char_length, int rnn_layer_size) {
+		_sent_capacity = sent_length;
+		_char_capacity = char_length;
 		_word_inputs.resize(sent_length);
-		_word_window.resize(sent_length);
 		_rnn_lefts.resize(rnn_layer_size);
 		_rnn_rights.resize(rnn_layer_size);
+		_bi_rnns.resize(rnn_layer_size);
 		_rnn_concats.resize(rnn_layer_size);
 
 		for (int i = 0; i < rnn_layer_size; i++) {
 			_rnn_lefts[i].resize(sent_length);
 			_rnn_rights[i].resize(sent_length);
-			_rnn_concats[i].resize(sent_length);
 		}
 
-		_avg_word_pooling.setParam(sent_length);
-		_max_word_pooling.setParam(sent_length);
-		_min_word_pooling.setParam(sent_length);
-
 		_char_inputs.resize(char_length);
-		_char_window.resize(char_length);
-		_char_hidden.resize(char_length);
-		_avg_char_pooling.setParam(char_length);
-		_max_char_pooling.setParam(char_length);
-		_min_char_pooling.setParam(char_length);
 	}
 
 	inline void clear(){
 		Graph::clear();
 		_word_inputs.clear();
-		_word_window.clear();
+
+		for (int idx = 0; idx < _rnn_lefts.size(); idx++) {
+			_rnn_lefts[idx].clear();
+			_rnn_rights[idx].clear();
+		}
+
+		_rnn_lefts.clear();
+		_rnn_rights.clear();
+		_bi_rnns.clear();
+		_rnn_concats.clear();
 		_char_inputs.clear();
-		_char_window.clear();
-		_char_hidden.clear();
 	}
 
 public:
-	inline void initial(ModelParams& model, HyperParams& opts, AlignedMemoryPool* mem = NULL){
+	inline void initial(ModelParams& model, HyperParams& opts, AlignedMemoryPool* mem = NULL, bool inference = false){
+		_model = &model;
+		_opts = &opts;
+		_mem = mem;
+		_inference = inference;
+		initialNodes();
+
+		// the threads are started once, reserve() only creates the nodes again
+		if (opts.hoistRNN)
+			_direction_pool.start(1);
+		_char_branch.init(opts.parallelBranches);
+	}
+
+	// the nodes of createNodes(), with the params and pool given to initial()
+	inline void initialNodes(){
+		ModelParams& model = *_model;
+		HyperParams& opts = *_opts;
+		AlignedMemoryPool* mem = _mem;
 		rnn_layer_size = opts.rnnLayerSize;
 		for (int idx = 0; idx < _word_inputs.size(); idx++) {
-			_word_inputs[idx].setParam(&model.words);
-			_word_inputs[idx].init(opts.wordDim, opts.dropProb, mem);
+			_word_inputs[idx].setParam(&model.words, &model.word_rows);
+			_word_inputs[idx].init(opts.wordDim, opts.dropProb, mem, _inference);
 		}
 	
-		_word_window.init(opts.wordDim, opts.wordContext, mem);
+		_word_window.init(opts.wordDim, opts.wordContext);
 		for (int idx = 0; idx < rnn_layer_size; idx++) {
-			_rnn_lefts[idx].init(&model.rnn_left_layers[idx], opts.dropProb, true, mem);
-			_rnn_rights[idx].init(&model.rnn_right_layers[idx], opts.dropProb, false, mem);
-			for (int idy = 0; idy < _rnn_concats[idx].size(); idy++)
-				_rnn_concats[idx][idy].init(opts.rnnHiddenSize * 2, -1, mem);
+			_rnn_lefts[idx].init(&model.rnn_left_layers[idx], opts.dropProb, true, mem, opts.hoistRNN, _inference);
+			_rnn_rights[idx].init(&model.rnn_right_layers[idx], opts.dropProb, false, mem, opts.hoistRNN, _inference);
+			_bi_rnns[idx].setParam(&_rnn_lefts[idx], &_rnn_rights[idx], &_direction_pool);
+			_rnn_concats[idx].init(opts.rnnHiddenSize * 2, -1);
 		}
 
-		_avg_word_pooling.init(opts.rnnHiddenSize * 2, -1, mem);
-		_max_word_pooling.init(opts.rnnHiddenSize * 2, -1, mem);
-		_min_word_pooling.init(opts.rnnHiddenSize * 2, -1, mem);
-		_word_pooling_concat.init(opts.rnnHiddenSize * 2 * 3, -1, mem);
+		_word_pooling.init(opts.rnnHiddenSize * 2, -1, mem, _inference);
 
 		for (int idx = 0; idx < _char_inputs.size(); idx++) {
-			_char_inputs[idx].setParam(&model.chars);
-			_char_inputs[idx].init(opts.charDim, opts.dropProb, mem);
-			_char_hidden[idx].setParam(&model.char_hidden_linear);
-			_char_hidden[idx].init(opts.charHiddenSize, opts.dropProb, mem);
+			_char_inputs[idx].setParam(&model.chars, &model.char_rows);
+			_char_inputs[idx].init(opts.charDim, opts.dropProb, mem, _inference);
 		}
 
-		_char_window.init(opts.charDim, opts.charContext, mem);
-		_avg_char_pooling.init(opts.charHiddenSize, -1, mem);
-		_max_char_pooling.init(opts.charHiddenSize, -1, mem);
-		_min_char_pooling.init(opts.charHiddenSize, -1, mem);
-		_char_pooling_concat.init(opts.charHiddenSize * 3, -1, mem);
+		_char_window.init(opts.charDim, opts.charContext);
+		_char_hidden.setParam(&model.char_hidden_linear);
+		_char_hidden.init(opts.charHiddenSize, opts.dropProb);
+		_char_pooling.init(opts.charHiddenSize, -1, mem, _inference);
 
 		_concat.init(opts.charHiddenSize * 3 + opts.rnnHiddenSize  * 2 * 3, -1, mem);
 		_output.setParam(&model.olayer_linear);
@@ -123,57 +150,87 @@ public:
 
 
 public:
+	// grows the nodes to hold words_num words and chars_num chars, doubling the lengths they are
+	// created for so that a corpus causes few rebuilds. the Driver calls it before a block of sentences is built,
+	// never inside forward(); the grown nodes come from the pool of the graph.
+	inline void reserve(int words_num, int chars_num){
+		if (words_num > max_sentence_length)
+			words_num = max_sentence_length;
+		if (chars_num > max_char_length)
+			chars_num = max_char_length;
+		if ((words_num <= _sent_capacity && chars_num <= _char_capacity) || _model == NULL)
+			return;
+
+		int sent_length = _sent_capacity > 0 ? _sent_capacity : 1;
+		while (sent_length < words_num)
+			sent_length *= 2;
+		if (sent_length > max_sentence_length)
+			sent_length = max_sentence_length;
+		int char_length = _char_capacity > 0 ? _char_capacity : 1;
+		while (char_length < chars_num)
+			char_length *= 2;
+		if (char_length > max_char_length)
+			char_length = max_char_length;
+
+		// the graph drops its pointers to the nodes of the last sentence before they are destroyed
+		clearValue();
+		_char_branch.release();
+		clear();
+		createNodes(sent_length, char_length, rnn_layer_size);
+		initialNodes();
+	}
+
 	// some nodes may behave different during training and decode, for example, dropout
 	inline void forward(const Feature& feature, bool bTrain = false){
 		//first step: clear value
 		clearValue(bTrain); // compute is a must step for train, predict and cost computation
 
+		// the char branch, on its own thread with parallelBranches
+		_char_branch.begin(this, [this, &feature](Graph* cg) { forwardChars(cg, feature); });
+
 		// second step: build graph
 		//forward
-		int words_num = feature.m_tweet_words.size();
-		if (words_num > max_sentence_length)
-			words_num = max_sentence_length;
+		int words_num = feature.wordNum();
+		if (words_num > _sent_capacity)
+			words_num = _sent_capacity;
 		for (int idx = 0; idx < words_num; idx++) {
-			_word_inputs[idx].forward(this, feature.m_tweet_words[idx]);
+			_word_inputs[idx].forward(this, feature.wordIds()[idx]);
 		}
 
 		_word_window.forward(this, getPNodes(_word_inputs, words_num));
 
-		_rnn_lefts[0].forward(this, getPNodes(_word_window._outputs, words_num));
-		_rnn_rights[0].forward(this, getPNodes(_word_window._outputs, words_num));
-		for (int i = 0; i < words_num; i++)
-			_rnn_concats[0][i].forward(this, &_rnn_lefts[0]._output[i], &_rnn_rights[0]._output[i]);
+		_bi_rnns[0].forward(this, &_word_window);
+		_rnn_concats[0].forward(this, _rnn_lefts[0].output(), _rnn_rights[0].output());
 
 		for (int idx = 1; idx < rnn_layer_size; idx++) {
-			_rnn_lefts[idx].forward(this, getPNodes(_rnn_concats[idx - 1], words_num));
-			_rnn_rights[idx].forward(this, getPNodes(_rnn_concats[idx - 1], words_num));
-			for (int i = 0; i < words_num; i++)
-				_rnn_concats[idx][i].forward(this, &_rnn_lefts[idx]._output[i], &_rnn_rights[idx]._output[i]);
+			_bi_rnns[idx].forward(this, &_rnn_concats[idx - 1]);
+			_rnn_concats[idx].forward(this, _rnn_lefts[idx].output(), _rnn_rights[idx].output());
 		}
 
-		_avg_word_pooling.forward(this, getPNodes(_rnn_concats[rnn_layer_size - 1], words_num));
-		_max_word_pooling.forward(this, getPNodes(_rnn_concats[rnn_layer_size - 1], words_num));
-		_min_word_pooling.forward(this, getPNodes(_rnn_concats[rnn_layer_size - 1], words_num));
-		_word_pooling_concat.forward(this, &_avg_word_pooling, &_max_word_pooling, &_min_word_pooling);
+		_word_pooling.forward(this, &_rnn_concats[rnn_layer_size - 1]);
 
-		int chars_num = feature.m_chars.size();
-		if (chars_num > max_char_length)
-			chars_num = max_char_length;
-		for (int i = 0; i < chars_num; i++) {
-			_char_inputs[i].forward(this, feature.m_chars[i]);
-		}
-		_char_window.forward(this, getPNodes(_char_inputs, chars_num));
+		_char_branch.join(this);
+		_concat.forward(this, &_word_pooling, &_char_pooling);
+		_output.forward(this, &_concat);
+	}
 
+	inline void backward(){
+		Graph::backward();
+		_char_branch.wait();
+	}
+
+	// the char pipeline up to _char_pooling
+	inline void forwardChars(Graph* cg, const Feature& feature){
+		int chars_num = feature.charNum();
+		if (chars_num > _char_capacity)
+			chars_num = _char_capacity;
 		for (int i = 0; i < chars_num; i++) {
-			_char_hidden[i].forward(this, &_char_window._outputs[i]);
+			_char_inputs[i].forward(cg, feature.charIds()[i]);
 		}
-		_avg_char_pooling.forward(this, getPNodes(_char_hidden, chars_num));
-		_max_char_pooling.forward(this, getPNodes(_char_hidden, chars_num));
-		_min_char_pooling.forward(this, getPNodes(_char_hidden, chars_num));
-		_char_pooling_concat.forward(this, &_avg_char_pooling, &_max_char_pooling, &_min_char_pooling);
+		_char_window.forward(cg, getPNodes(_char_inputs, chars_num));
 
-		_concat.forward(this, &_word_pooling_concat, &_char_pooling_concat);
-		_output.forward(this, &_concat);
+		_char_hidden.forward(cg, &_char_window);
+		_char_pooling.forward(cg, &_char_hidden);
 	}
 };
 
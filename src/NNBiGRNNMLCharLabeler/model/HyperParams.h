@@ -4,6 +4,7 @@
 #include "N3L.h"
 #include "Example.h"
 #include "Options.h"
+#include "ModelFile.h"
 
 using namespace nr;
 using namespace std;
@@ -25,6 +26,8 @@ struct HyperParams{
 	int wordWindowOutput;
 	int charWindowOutput;
 	dtype dropProb;
+	bool parallelBranches; // char branch on its own thread
+	bool hoistRNN; // input projections of all steps in one GEMM
 
 
 	//auto generated
@@ -37,6 +40,8 @@ struct HyperParams{
 public:
 	HyperParams(){
 		bAssigned = false;
+		parallelBranches = false;
+		hoistRNN = true;
 	}
 
 public:
@@ -49,11 +54,18 @@ public:
 		wordContext = opt.wordcontext;
 		charContext = opt.charcontext;
 		dropProb = opt.dropProb;
+		setRuntime(opt);
 		rnnLayerSize = opt.rnnLayerSize;
 
 		bAssigned = true;
 	}
 
+	// execution flags, taken from the options of every run and not stored with the model
+	void setRuntime(Options& opt){
+		parallelBranches = opt.parallelBranches;
+		hoistRNN = opt.hoistRNN;
+	}
+
 	void clear(){
 		bAssigned = false;
 	}
@@ -63,10 +75,54 @@ public:
 	}
 
 
-	void saveModel(std::ofstream &os) const{
+	void saveModel(ModelWriter& writer) const {
+		writer.write(nnRegular);
+		writer.write(adaAlpha);
+		writer.write(adaEps);
+
+		writer.write(rnnHiddenSize);
+		writer.write(wordContext);
+		writer.write(wordWindow);
+
+		writer.write(charHiddenSize);
+		writer.write(charContext);
+		writer.write(charWindow);
+
+		writer.write(wordWindowOutput);
+		writer.write(charWindowOutput);
+		writer.write(dropProb);
+
+		writer.write(wordDim);
+		writer.write(charDim);
+		writer.write(inputSize);
+		writer.write(labelSize);
+		writer.write(rnnLayerSize);
 	}
 
-	void loadModel(std::ifstream &is){
+	void loadModel(ModelReader& reader) {
+		reader.read(nnRegular);
+		reader.read(adaAlpha);
+		reader.read(adaEps);
+
+		reader.read(rnnHiddenSize);
+		reader.read(wordContext);
+		reader.read(wordWindow);
+
+		reader.read(charHiddenSize);
+		reader.read(charContext);
+		reader.read(charWindow);
+
+		reader.read(wordWindowOutput);
+		reader.read(charWindowOutput);
+		reader.read(dropProb);
+
+		reader.read(wordDim);
+		reader.read(charDim);
+		reader.read(inputSize);
+		reader.read(labelSize);
+		reader.read(rnnLayerSize);
+
+		bAssigned = reader.good();
 	}
 public:
 
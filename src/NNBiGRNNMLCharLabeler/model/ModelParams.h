@@ -1,6 +1,8 @@
 #ifndef SRC_ModelParams_H_
 #define SRC_ModelParams_H_
 #include "HyperParams.h"
+#include "IdSoftMaxLoss.h"
+#include "SparseRows.h"
 
 // Each model consists of two parts, building neural graph and defining output losses.
 class ModelParams{
@@ -8,8 +10,10 @@ class ModelParams{
 public:
 	Alphabet wordAlpha; // should be initialized outside
 	LookupTable words; // should be initialized outside
+	SparseRows word_rows; // gradients of words in a replica
 	Alphabet charAlpha; // should be initialized outside
 	LookupTable chars; // should be initialized outside
+	SparseRows char_rows; // gradients of chars in a replica
 
 	vector<GRNNParams> rnn_left_layers;
 	vector<GRNNParams> rnn_right_layers;
@@ -19,7 +23,7 @@ public:
 	int rnn_layer_size;
 public:
 	Alphabet labelAlpha; // should be initialized outside
-	SoftMaxLoss loss;
+	IdSoftMaxLoss loss;
 
 
 public:
@@ -76,6 +80,28 @@ public:
 		return true;
 	}
 
+	// the layout of a data-parallel worker: its tables take the shape of the master without any buffers,
+	// GradientReplica binds the values to the master afterwards and keeps the table gradients in the rows
+	bool initialReplica(const ModelParams& master, HyperParams& opts, AlignedMemoryPool* mem = NULL){
+		replicaTable(words, master.words);
+		replicaTable(chars, master.chars);
+		labelAlpha = master.labelAlpha;
+		return initial(opts, mem);
+	}
+
+	// a copy of the master with buffers of its own, refreshed by Driver::takeSnapshot()
+	bool initialSnapshot(const ModelParams& master, HyperParams& opts, AlignedMemoryPool* mem = NULL){
+		words.initial(master.words.elems, master.words.nDim, master.words.bFineTune);
+		chars.initial(master.chars.elems, master.chars.nDim, master.chars.bFineTune);
+		// untuned embeddings are not exported, so takeSnapshot() never copies them: they are copied once here
+		if (!words.bFineTune)
+			words.E.val.mat() = master.words.E.val.mat();
+		if (!chars.bFineTune)
+			chars.E.val.mat() = master.chars.E.val.mat();
+		labelAlpha = master.labelAlpha;
+		return initial(opts, mem);
+	}
+
 	void exportModelParams(ModelUpdate& ada){
 		words.exportAdaParams(ada);
 		chars.exportAdaParams(ada);
@@ -93,11 +119,36 @@ public:
 		checkgrad.add(&(olayer_linear.W), "olayer_linear.W");
 	}
 
-	// will add it later
-	void saveModel(std::ofstream &os) const{
+	void saveModel(ModelWriter& writer) const {
+		writer.write(wordAlpha);
+		writer.write(words);
+		writer.write(charAlpha);
+		writer.write(chars);
+		writer.write(labelAlpha);
+		for (int i = 0; i < rnn_layer_size; i++) {
+			writer.write(rnn_left_layers[i]);
+			writer.write(rnn_right_layers[i]);
+		}
+		writer.write(char_hidden_linear);
+		writer.write(olayer_linear);
 	}
 
-	void loadModel(std::ifstream &is, AlignedMemoryPool* mem = NULL){
+	// the shapes and values of the layers come from the file, TestInitial() only derives the hyperparameters
+	bool loadModel(ModelReader& reader, HyperParams& opts, AlignedMemoryPool* mem = NULL) {
+		reader.read(wordAlpha);
+		reader.read(words, &wordAlpha);
+		reader.read(charAlpha);
+		reader.read(chars, &charAlpha);
+		reader.read(labelAlpha);
+		if (!reader.good() || !TestInitial(opts, mem))
+			return false;
+		for (int i = 0; i < rnn_layer_size; i++) {
+			reader.read(rnn_left_layers[i]);
+			reader.read(rnn_right_layers[i]);
+		}
+		reader.read(char_hidden_linear);
+		reader.read(olayer_linear);
+		return reader.good();
 	}
 
 };
@@ -0,0 +1,58 @@
+#ifndef SRC_BatchComputionGraph_H_
+#define SRC_BatchComputionGraph_H_
+
+#include "ComputionGraph.h"
+#include "BatchLayers.h"
+
+
+// The graph of ComputionGraph over a whole minibatch, every LSTM step is one GEMM for all sentences.
+struct BatchComputionGraph {
+public:
+	BatchWordWindow _word_window;
+	BatchLSTM _left_rnn;
+	BatchLSTM _right_rnn;
+	BatchMat _rnn_concat;
+	BatchMat _rnn_concat_loss;
+	BatchPooling _pooling;
+	BatchOutput _output;
+
+public:
+	inline void initial(ModelParams& model, HyperParams& opts){
+		_word_window.init(&model.words, opts.wordContext, opts.dropProb, &model.word_rows);
+		_left_rnn.init(&model.left_rnn_params, opts.dropProb, true);
+		_right_rnn.init(&model.right_rnn_params, opts.dropProb, false);
+		_output.init(&model.olayer_linear);
+	}
+
+public:
+	inline void forward(const vector<const Feature*>& features, bool bTrain = false){
+		_word_window.forward(features, ComputionGraph::max_sentence_length, bTrain);
+		_left_rnn.forward(_word_window._outputs, _word_window._lengths, _word_window._steps, bTrain);
+		_right_rnn.forward(_word_window._outputs, _word_window._lengths, _word_window._steps, bTrain);
+
+		int hiddenSize = _left_rnn._outDim;
+		_rnn_concat.resize(hiddenSize * 2, _left_rnn._hiddens.cols());
+		_rnn_concat.topRows(hiddenSize) = _left_rnn._hiddens;
+		_rnn_concat.bottomRows(hiddenSize) = _right_rnn._hiddens;
+
+		_pooling.forward(_rnn_concat, _word_window._lengths);
+		_output.forward(_pooling._outputs);
+	}
+
+	// call after the loss of every sentence has been set through _output.loss
+	inline void backward(){
+		_output.backward();
+		_pooling._outputs_loss = _output._inputs_loss;
+		_rnn_concat_loss.setZero(_rnn_concat.rows(), _rnn_concat.cols());
+		_pooling.backward(_rnn_concat_loss);
+
+		int hiddenSize = _left_rnn._outDim;
+		_left_rnn._hiddens_loss = _rnn_concat_loss.topRows(hiddenSize);
+		_right_rnn._hiddens_loss = _rnn_concat_loss.bottomRows(hiddenSize);
+		_left_rnn.backward(_word_window._outputs, _word_window._outputs_loss);
+		_right_rnn.backward(_word_window._outputs, _word_window._outputs_loss);
+		_word_window.backward();
+	}
+};
+
+#endif /* SRC_BatchComputionGraph_H_ */
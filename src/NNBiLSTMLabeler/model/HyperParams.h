@@ -4,6 +4,7 @@
 #include "N3L.h"
 #include "Example.h"
 #include "Options.h"
+#include "ModelFile.h"
 
 using namespace nr;
 using namespace std;
@@ -19,6 +20,8 @@ struct HyperParams{
 	int wordWindow;
 	int windowOutput;
 	dtype dropProb;
+	bool hoistRNN; // input projections of all steps in one GEMM
+	bool batchRNN; // train on BatchComputionGraph
 
 
 	//auto generated
@@ -29,6 +32,8 @@ struct HyperParams{
 public:
 	HyperParams(){
 		bAssigned = false;
+		hoistRNN = true;
+		batchRNN = false;
 	}
 
 public:
@@ -39,10 +44,17 @@ public:
 		hiddenSize = opt.hiddenSize;
 		wordContext = opt.wordcontext;
 		dropProb = opt.dropProb;
+		setRuntime(opt);
 
 		bAssigned = true;
 	}
 
+	// execution flags, taken from the options of every run and not stored with the model
+	void setRuntime(Options& opt){
+		hoistRNN = opt.hoistRNN;
+		batchRNN = opt.batchRNN;
+	}
+
 	void clear(){
 		bAssigned = false;
 	}
@@ -52,40 +64,38 @@ public:
 	}
 
 
-	void saveModel(std::ofstream &os) const{
-		os << nnRegular << std::endl;
-		os << adaAlpha << std::endl;
-		os << adaEps << std::endl;
-
-		os << hiddenSize << std::endl;
-		os << wordContext << std::endl;
-		os << wordWindow << std::endl;
-		os << windowOutput << std::endl;
-		os << dropProb << std::endl;
+	void saveModel(ModelWriter& writer) const {
+		writer.write(nnRegular);
+		writer.write(adaAlpha);
+		writer.write(adaEps);
 
+		writer.write(hiddenSize);
+		writer.write(wordContext);
+		writer.write(wordWindow);
+		writer.write(windowOutput);
+		writer.write(dropProb);
 
-		os << wordDim << std::endl;
-		os << inputSize << std::endl;
-		os << labelSize << std::endl;
+		writer.write(wordDim);
+		writer.write(inputSize);
+		writer.write(labelSize);
 	}
 
-	void loadModel(std::ifstream &is){
-		is >> nnRegular;
-		is >> adaAlpha;
-		is >> adaEps;
+	void loadModel(ModelReader& reader) {
+		reader.read(nnRegular);
+		reader.read(adaAlpha);
+		reader.read(adaEps);
 
-		is >> hiddenSize;
-		is >> wordContext;
-		is >> wordWindow;
-		is >> windowOutput;
-		is >> dropProb;
+		reader.read(hiddenSize);
+		reader.read(wordContext);
+		reader.read(wordWindow);
+		reader.read(windowOutput);
+		reader.read(dropProb);
 
+		reader.read(wordDim);
+		reader.read(inputSize);
+		reader.read(labelSize);
 
-		is >> wordDim;
-		is >> inputSize;
-		is >> labelSize;
-
-		bAssigned = true;
+		bAssigned = reader.good();
 	}
 public:
 
@@ -1,6 +1,8 @@
 #ifndef SRC_ModelParams_H_
 #define SRC_ModelParams_H_
 #include "HyperParams.h"
+#include "IdSoftMaxLoss.h"
+#include "SparseRows.h"
 
 // Each model consists of two parts, building neural graph and defining output losses.
 class ModelParams{
@@ -8,12 +10,13 @@ class ModelParams{
 public:
 	Alphabet wordAlpha; // should be initialized outside
 	LookupTable words; // should be initialized outside
+	SparseRows word_rows; // gradients of words in a replica
 	LSTMParams left_rnn_params;
 	LSTMParams right_rnn_params;
 	UniParams olayer_linear; // output
 public:
 	Alphabet labelAlpha; // should be initialized outside
-	SoftMaxLoss loss;
+	IdSoftMaxLoss loss;
 
 
 public:
@@ -48,6 +51,24 @@ public:
 		return true;
 	}
 
+	// the layout of a data-parallel worker: its tables take the shape of the master without any buffers,
+	// GradientReplica binds the values to the master afterwards and keeps the table gradients in the rows
+	bool initialReplica(const ModelParams& master, HyperParams& opts, AlignedMemoryPool* mem = NULL){
+		replicaTable(words, master.words);
+		labelAlpha = master.labelAlpha;
+		return initial(opts, mem);
+	}
+
+	// a copy of the master with buffers of its own, refreshed by Driver::takeSnapshot()
+	bool initialSnapshot(const ModelParams& master, HyperParams& opts, AlignedMemoryPool* mem = NULL){
+		words.initial(master.words.elems, master.words.nDim, master.words.bFineTune);
+		// untuned embeddings are not exported, so takeSnapshot() never copies them: they are copied once here
+		if (!words.bFineTune)
+			words.E.val.mat() = master.words.E.val.mat();
+		labelAlpha = master.labelAlpha;
+		return initial(opts, mem);
+	}
+
 	void exportModelParams(ModelUpdate& ada){
 		words.exportAdaParams(ada);
 		left_rnn_params.exportAdaParams(ada);
@@ -61,11 +82,26 @@ public:
 		checkgrad.add(&(olayer_linear.W), "olayer_linear.W");
 	}
 
-	// will add it later
-	void saveModel(std::ofstream &os) const{
+	void saveModel(ModelWriter& writer) const {
+		writer.write(wordAlpha);
+		writer.write(words);
+		writer.write(labelAlpha);
+		writer.write(left_rnn_params);
+		writer.write(right_rnn_params);
+		writer.write(olayer_linear);
 	}
 
-	void loadModel(std::ifstream &is, AlignedMemoryPool* mem = NULL){
+	// the shapes and values of the layers come from the file, TestInitial() only derives the hyperparameters
+	bool loadModel(ModelReader& reader, HyperParams& opts, AlignedMemoryPool* mem = NULL) {
+		reader.read(wordAlpha);
+		reader.read(words, &wordAlpha);
+		reader.read(labelAlpha);
+		if (!reader.good() || !TestInitial(opts, mem))
+			return false;
+		reader.read(left_rnn_params);
+		reader.read(right_rnn_params);
+		reader.read(olayer_linear);
+		return reader.good();
 	}
 
 };
@@ -4,6 +4,7 @@
 #include "N3L.h"
 #include "Example.h"
 #include "Options.h"
+#include "ModelFile.h"
 
 using namespace nr;
 using namespace std;
@@ -25,6 +26,7 @@ struct HyperParams{
 	int wordWindowOutput;
 	int charWindowOutput;
 	dtype dropProb;
+	bool parallelBranches; // char branch on its own thread
 
 
 	//auto generated
@@ -36,6 +38,7 @@ struct HyperParams{
 public:
 	HyperParams(){
 		bAssigned = false;
+		parallelBranches = false;
 	}
 
 public:
@@ -48,10 +51,16 @@ public:
 		wordContext = opt.wordcontext;
 		charContext = opt.charcontext;
 		dropProb = opt.dropProb;
+		setRuntime(opt);
 
 		bAssigned = true;
 	}
 
+	// execution flags, taken from the options of every run and not stored with the model
+	void setRuntime(Options& opt){
+		parallelBranches = opt.parallelBranches;
+	}
+
 	void clear(){
 		bAssigned = false;
 	}
@@ -61,10 +70,52 @@ public:
 	}
 
 
-	void saveModel(std::ofstream &os) const{
+	void saveModel(ModelWriter& writer) const {
+		writer.write(nnRegular);
+		writer.write(adaAlpha);
+		writer.write(adaEps);
+
+		writer.write(wordHiddenSize);
+		writer.write(wordContext);
+		writer.write(wordWindow);
+
+		writer.write(charHiddenSize);
+		writer.write(charContext);
+		writer.write(charWindow);
+
+		writer.write(wordWindowOutput);
+		writer.write(charWindowOutput);
+		writer.write(dropProb);
+
+		writer.write(wordDim);
+		writer.write(charDim);
+		writer.write(inputSize);
+		writer.write(labelSize);
 	}
 
-	void loadModel(std::ifstream &is){
+	void loadModel(ModelReader& reader) {
+		reader.read(nnRegular);
+		reader.read(adaAlpha);
+		reader.read(adaEps);
+
+		reader.read(wordHiddenSize);
+		reader.read(wordContext);
+		reader.read(wordWindow);
+
+		reader.read(charHiddenSize);
+		reader.read(charContext);
+		reader.read(charWindow);
+
+		reader.read(wordWindowOutput);
+		reader.read(charWindowOutput);
+		reader.read(dropProb);
+
+		reader.read(wordDim);
+		reader.read(charDim);
+		reader.read(inputSize);
+		reader.read(labelSize);
+
+		bAssigned = reader.good();
 	}
 public:
 
@@ -2,27 +2,40 @@
 #define SRC_ComputionGraph_H_
 
 #include "ModelParams.h"
+#include "IdLookupNode.h"
+#include "SequenceNodes.h"
 
 
 // Each model consists of two parts, building neural graph and defining output losses.
 struct ComputionGraph : Graph{
 public:
 	const static int max_sentence_length = 2048;
+	// the nodes first created without corpus lengths, reserve() grows them up to the max length on demand
+	const static int initial_sentence_length = 64;
 
 public:
 	// node instances
-	vector<LookupNode> _word_inputs;
-	WindowBuilder _word_window;
-	vector<UniNode> _hidden;
+	vector<IdLookupNode> _word_inputs;
+	WindowSeqNode _word_window;
+	UniSeqNode _hidden;
 
-	AvgPoolNode _avg_pooling;
-	MaxPoolNode _max_pooling;
-	MinPoolNode _min_pooling;
-
-	ConcatNode _concat;
+	PoolingSeqNode _pooling;
 	LinearNode _output;
+
+	// the lengths the nodes are created for, and what reserve() creates them again with
+	int _sent_capacity;
+	ModelParams* _model;
+	HyperParams* _opts;
+	AlignedMemoryPool* _mem;
+	// a graph that only decodes, whose nodes keep no backward state
+	bool _inference;
 public:
 	ComputionGraph() : Graph(){
+		_sent_capacity = 0;
+		_model = NULL;
+		_opts = NULL;
+		_mem = NULL;
+		_inference = false;
 	}
 
 	~ComputionGraph(){
@@ -32,40 +45,65 @@ public:
 public:
 	//allocate enough nodes 
 	inline void createNodes(int sent_length){
+		_sent_capacity = sent_length;
 		_word_inputs.resize(sent_length);
-		_word_window.resize(sent_length);
-		_hidden.resize(sent_length);
-		_avg_pooling.setParam(sent_length);
-		_max_pooling.setParam(sent_length);
-		_min_pooling.setParam(sent_length);
 	}
 
 	inline void clear(){
 		Graph::clear();
 		_word_inputs.clear();
-		_word_window.clear();
-		_hidden.clear();
 	}
 
 public:
-	inline void initial(ModelParams& model, HyperParams& opts, AlignedMemoryPool* mem = NULL){
+	inline void initial(ModelParams& model, HyperParams& opts, AlignedMemoryPool* mem = NULL, bool inference = false){
+		_model = &model;
+		_opts = &opts;
+		_mem = mem;
+		_inference = inference;
+		initialNodes();
+	}
+
+	// the nodes of createNodes(), with the params and pool given to initial()
+	inline void initialNodes(){
+		ModelParams& model = *_model;
+		HyperParams& opts = *_opts;
+		AlignedMemoryPool* mem = _mem;
 		for (int idx = 0; idx < _word_inputs.size(); idx++) {
-			_word_inputs[idx].setParam(&model.words);
-			_word_inputs[idx].init(opts.wordDim, opts.dropProb, mem);
-			_hidden[idx].setParam(&model.hidden_linear);
-			_hidden[idx].init(opts.hiddenSize, opts.dropProb, mem);
+			_word_inputs[idx].setParam(&model.words, &model.word_rows);
+			_word_inputs[idx].init(opts.wordDim, opts.dropProb, mem, _inference);
 		}
-		_word_window.init(opts.wordDim, opts.wordContext, mem);
-		_avg_pooling.init(opts.hiddenSize, -1, mem);
-		_max_pooling.init(opts.hiddenSize, -1, mem);
-		_min_pooling.init(opts.hiddenSize, -1, mem);
-		_concat.init(opts.hiddenSize * 3, -1, mem);
+		_word_window.init(opts.wordDim, opts.wordContext);
+		_hidden.setParam(&model.hidden_linear);
+		_hidden.init(opts.hiddenSize, opts.dropProb);
+		_pooling.init(opts.hiddenSize, -1, mem, _inference);
 		_output.setParam(&model.olayer_linear);
 		_output.init(opts.labelSize, -1, mem);
 	}
 
 
 public:
+	// grows the nodes to hold words_num words, doubling the length they are created for
+	// so that a corpus causes few rebuilds. the Driver calls it before a block of sentences is built,
+	// never inside forward(); the grown nodes come from the pool of the graph.
+	inline void reserve(int words_num){
+		if (words_num > max_sentence_length)
+			words_num = max_sentence_length;
+		if (words_num <= _sent_capacity || _model == NULL)
+			return;
+
+		int sent_length = _sent_capacity > 0 ? _sent_capacity : 1;
+		while (sent_length < words_num)
+			sent_length *= 2;
+		if (sent_length > max_sentence_length)
+			sent_length = max_sentence_length;
+
+		// the graph drops its pointers to the nodes of the last sentence before they are destroyed
+		clearValue();
+		clear();
+		createNodes(sent_length);
+		initialNodes();
+	}
+
 	// some nodes may behave different during training and decode, for example, dropout
 	inline void forward(const Feature& feature, bool bTrain = false){
 		//first step: clear value
@@ -73,22 +111,17 @@ public:
 
 		// second step: build graph
 		//forward
-		int words_num = feature.m_tweet_words.size();
-		if (words_num > max_sentence_length)
-			words_num = max_sentence_length;
+		int words_num = feature.wordNum();
+		if (words_num > _sent_capacity)
+			words_num = _sent_capacity;
 		for (int i = 0; i < words_num; i++) {
-			_word_inputs[i].forward(this, feature.m_tweet_words[i]);
+			_word_inputs[i].forward(this, feature.wordIds()[i]);
 		}
 		_word_window.forward(this, getPNodes(_word_inputs, words_num));
 
-		for (int i = 0; i < words_num; i++) {
-			_hidden[i].forward(this, &_word_window._outputs[i]);
-		}
-		_avg_pooling.forward(this, getPNodes(_hidden, words_num));
-		_max_pooling.forward(this, getPNodes(_hidden, words_num));
-		_min_pooling.forward(this, getPNodes(_hidden, words_num));
-		_concat.forward(this, &_avg_pooling, &_max_pooling, &_min_pooling);
-		_output.forward(this, &_concat);
+		_hidden.forward(this, &_word_window);
+		_pooling.forward(this, &_hidden);
+		_output.forward(this, &_pooling);
 	}
 };
 
@@ -10,6 +10,10 @@
 
 #include <iostream>
 #include "ComputionGraph.h"
+#include "GradientReplica.h"
+#include "LazySparseUpdate.h"
+#include "ThreadPool.h"
+#include "MemoryReport.h"
 
 
 //A native neural network classfier using only word embeddings
@@ -17,10 +21,21 @@
 class Driver{
 public:
 	Driver(int memsize) :_aligned_mem(memsize){
+		_memsize = memsize;
 		_pcg = NULL;
+		_word_table = _char_table = -1;
 	}
 
 	~Driver() {
+		waitSnapshot();
+		for (int idx = 0; idx < _snapshot_pcgs.size(); idx++)
+			delete _snapshot_pcgs[idx];
+		for (int idx = 1; idx < _pcgs.size(); idx++)
+			delete _pcgs[idx];
+		for (int idx = 1; idx < _worker_params.size(); idx++) {
+			_replicas[idx].release();
+			delete _worker_params[idx];
+		}
 		if (_pcg != NULL)
 			delete _pcg;
 		_pcg = NULL;
@@ -28,18 +43,35 @@ public:
 
 public:
 	ComputionGraph *_pcg;  // build neural graphs
+	vector<ComputionGraph*> _pcgs;  // one graph per training worker, _pcgs[0] is _pcg
+	vector<ModelParams*> _worker_params;  // gradients of each worker, _worker_params[0] is &_modelparams
+	vector<GradientReplica> _replicas;
+	vector<Metric> _worker_evals;
+	vector<dtype> _worker_costs;
+	ThreadPool _pool;
 	ModelParams _modelparams;  // model parameters
+	ModelParams _snapshot_params;  // copy of _modelparams evaluated in the background if asyncEval
+	ModelUpdate _snapshot_ada;  // parameters of the snapshot in the order of _ada
+	vector<ComputionGraph*> _snapshot_pcgs;
+	ThreadPool _snapshot_pool;
+	future<void> _snapshot_task;
 	HyperParams _hyperparams;
 
 	Metric _eval;
 	CheckGrad _checkgrad;
 	ModelUpdate _ada;  // model update
+	LazySparseUpdate _sparse_ada;  // _ada visiting only the touched rows of the embeddings
+	int _word_table, _char_table;  // table indexes in _sparse_ada
 	AlignedMemoryPool _aligned_mem;
+	mutex _reserve_lock;  // the graphs grow from _aligned_mem, which is not thread-safe
+	int _memsize;
+	MemoryReport _memory;  // what initial() and TestInitial() allocated, and the peak afterwards
+	ModelReader _model_file;  // a loaded model stays mapped here, destroyed before the parameters using it
 
 
 public:
 	//embeddings are initialized before this separately.
-	inline void initial() {
+	inline void initial(int nThreads = 1) {
 		if (!_hyperparams.bValid()){
 			std::cout << "hyper parameter initialization Error, Please check!" << std::endl;
 			return;
@@ -50,17 +82,26 @@ public:
 		}
 		_modelparams.exportModelParams(_ada);
 		_modelparams.exportCheckGradParams(_checkgrad);
+		_memory.reset();
+		_memory.addParams(_ada);
 
 		_hyperparams.print();
 
+		_memory.beginGraphs();
 		_pcg = new ComputionGraph();
-		_pcg->createNodes(ComputionGraph::max_sentence_length, ComputionGraph::max_char_length, _hyperparams.cnnLayerSize);
+		_pcg->createNodes(sentenceCapacity(), charCapacity(), _hyperparams.cnnLayerSize);
 		_pcg->initial(_modelparams, _hyperparams, &_aligned_mem);
+		_memory.endGraphs();
 
 		setUpdateParameters(_hyperparams.nnRegular, _hyperparams.adaAlpha, _hyperparams.adaEps);
+		_sparse_ada.initial(&_ada);
+		_word_table = _sparse_ada.addTable(&_modelparams.words);
+		_char_table = _sparse_ada.addTable(&_modelparams.chars);
+		initialWorkers(nThreads);
+		_memory.print("initial", _memsize);
 	}
 
-	inline void TestInitial() {
+	inline void TestInitial(int nThreads = 1) {
 		if (!_hyperparams.bValid()){
 			std::cout << "hyper parameter initialization Error, Please check!" << std::endl;
 			return;
@@ -71,36 +112,83 @@ public:
 		}
 		_modelparams.exportModelParams(_ada);
 		_modelparams.exportCheckGradParams(_checkgrad);
+		_memory.reset();
+		_memory.addParams(_ada);
 
 		_hyperparams.print();
 
+		_memory.beginGraphs();
 		_pcg = new ComputionGraph();
-		_pcg->createNodes(ComputionGraph::max_sentence_length, ComputionGraph::max_char_length, _hyperparams.cnnLayerSize);
-		_pcg->initial(_modelparams, _hyperparams, &_aligned_mem);
+		_pcg->createNodes(sentenceCapacity(), charCapacity(), _hyperparams.cnnLayerSize);
+		_pcg->initial(_modelparams, _hyperparams, &_aligned_mem, true);
+		_memory.endGraphs();
 
 		setUpdateParameters(_hyperparams.nnRegular, _hyperparams.adaAlpha, _hyperparams.adaEps);
+		_pcgs.push_back(_pcg);
+
+		// more graphs over the same parameters for predict(), which only reads them
+		for (int idx = 1; idx < nThreads; idx++) {
+			_memory.beginGraphs();
+			ComputionGraph* pcg = new ComputionGraph();
+			pcg->createNodes(sentenceCapacity(), charCapacity(), _hyperparams.cnnLayerSize);
+			pcg->initial(_modelparams, _hyperparams, &_aligned_mem, true);
+			_memory.endGraphs();
+			_pcgs.push_back(pcg);
+		}
+		if (nThreads > 1)
+			_pool.start(nThreads);
+		_memory.print("TestInitial", _memsize);
+	}
+
+	// graphs of their own over the snapshot, one per worker
+	inline void initialSnapshot(int nThreads = 1) {
+		if (nThreads < 1)
+			nThreads = 1;
+		_snapshot_params.initialSnapshot(_modelparams, _hyperparams, &_aligned_mem);
+		_snapshot_params.wordAlpha = _modelparams.wordAlpha;
+		_snapshot_params.charAlpha = _modelparams.charAlpha;
+		_snapshot_params.exportModelParams(_snapshot_ada);
+		_memory.addParams(_snapshot_ada);
+		for (int idx = 0; idx < nThreads; idx++) {
+			_memory.beginGraphs();
+			ComputionGraph* pcg = new ComputionGraph();
+			pcg->createNodes(sentenceCapacity(), charCapacity(), _hyperparams.cnnLayerSize);
+			pcg->initial(_snapshot_params, _hyperparams, &_aligned_mem, true);
+			_memory.endGraphs();
+			_snapshot_pcgs.push_back(pcg);
+		}
+		// one more thread for the task waiting on the workers
+		_snapshot_pool.start(nThreads + 1);
+		_memory.print("initialSnapshot", _memsize);
 	}
 
-	inline dtype train(const vector<Example>& examples, int iter) {
+	inline dtype train(const vector<const Example*>& examples, int iter) {
 		_eval.reset();
 
 		int example_num = examples.size();
-		dtype cost = 0.0;
+		int worker_num = _pcgs.size() < example_num ? _pcgs.size() : example_num;
 
-		for (int count = 0; count < example_num; count++) {
-			const Example& example = examples[count];
+		// the embedding rows this minibatch may touch
+		for (int idx = 0; idx < example_num; idx++)
+			touchRows(examples[idx]->m_feature);
 
-			//forward
-			_pcg->forward(example.m_feature, true);
+		// forward and backward, each worker on its own slice of the minibatch
+		_pool.run(worker_num, [&](int worker) {
+			_worker_costs[worker] = trainWorker(examples, worker, worker_num);
+		});
 
-			//loss function
-			//for (int idx = 0; idx < seq_size; idx++) {
-			//cost += _loss.loss(&(_pcg->_output[idx]), example.m_labels[idx], _eval, example_num);				
-			//}
-			cost += _modelparams.loss.loss(&_pcg->_output, example.m_label, _eval, example_num);
+		// gradients of workers 1..n-1 are added into the master in worker order
+		_pool.run(worker_num > 1 ? _ada._params.size() : 0, [&](int idx) {
+			for (int worker = 1; worker < worker_num; worker++)
+				_replicas[worker].accumulate(idx);
+		});
+		_memory.sample();
 
-			// backward, which exists only for training 
-			_pcg->backward();
+		dtype cost = 0.0;
+		for (int worker = 0; worker < worker_num; worker++) {
+			cost += _worker_costs[worker];
+			_eval.overall_label_count += _worker_evals[worker].overall_label_count;
+			_eval.correct_label_count += _worker_evals[worker].correct_label_count;
 		}
 
 		if (_eval.getAccuracy() < 0) {
@@ -111,6 +199,7 @@ public:
 	}
 
 	inline void predict(const Feature& feature, int& result) {
+		reserve(_pcg, feature);
 		_pcg->forward(feature);
 		//results.resize(seq_size);
 		//for (int idx = 0; idx < seq_size; idx++) {
@@ -119,7 +208,64 @@ public:
 		_modelparams.loss.predict(&_pcg->_output, result);
 	}
 
+	// each worker predicts a contiguous slice of the examples on its own graph
+	inline void predict(const vector<const Example*>& examples, vector<int>& results) {
+		int example_num = examples.size();
+		int worker_num = _pcgs.size() < example_num ? _pcgs.size() : example_num;
+		results.resize(example_num);
+		_pool.run(worker_num, [&](int worker) {
+			predictWorker(_pcgs[worker], examples, results, worker, worker_num);
+		});
+		_memory.sample();
+	}
+
+	// predict() on the graph of one worker alone, for callers running the workers themselves
+	inline void predict(const vector<const Example*>& examples, vector<int>& results, int worker) {
+		results.resize(examples.size());
+		predictWorker(_pcgs[worker], examples, results, 0, 1);
+		_memory.sample();
+	}
+
+	// predict() along with the probabilities of all labels, labelAlpha.size() of them per example
+	inline void predict(const vector<const Example*>& examples, vector<int>& results, vector<dtype>& probs) {
+		int example_num = examples.size();
+		int worker_num = _pcgs.size() < example_num ? _pcgs.size() : example_num;
+		results.resize(example_num);
+		probs.resize(example_num * _modelparams.labelAlpha.size());
+		_pool.run(worker_num, [&](int worker) {
+			predictWorker(_pcgs[worker], examples, results, worker, worker_num, probs.data());
+		});
+		_memory.sample();
+	}
+
+	// copies the current parameters into the snapshot once its previous evaluation is over
+	inline void takeSnapshot() {
+		waitSnapshot();
+		for (int idx = 0; idx < _ada._params.size(); idx++)
+			_snapshot_ada._params[idx]->val.mat() = _ada._params[idx]->val.mat();
+	}
+
+	// predict() on the snapshot in the background, done is called there afterwards
+	inline void predictSnapshot(const vector<const Example*>& examples, vector<int>& results, const function<void()>& done) {
+		_snapshot_task = _snapshot_pool.push([this, &examples, &results, done]() {
+			int example_num = examples.size();
+			int worker_num = _snapshot_pcgs.size() < example_num ? _snapshot_pcgs.size() : example_num;
+			results.resize(example_num);
+			_snapshot_pool.run(worker_num, [&](int worker) {
+				predictWorker(_snapshot_pcgs[worker], examples, results, worker, worker_num);
+			});
+			_memory.sample();
+			done();
+		});
+	}
+
+	inline void waitSnapshot() {
+		if (_snapshot_task.valid())
+			_snapshot_task.get();
+	}
+
 	inline dtype cost(const Example& example){
+		reserve(_pcg, example.m_feature);
 		_pcg->forward(example.m_feature); //forward here
 
 
@@ -133,13 +279,17 @@ public:
 		return cost;
 	}
 
+	inline dtype cost(const Example* example){
+		return cost(*example);
+	}
+
 
 	void updateModel() {
 		//_ada.update();
-		_ada.update(5.0);
+		_sparse_ada.update(5.0);
 	}
 
-	void checkgrad(const vector<Example>& examples, int iter){
+	void checkgrad(const vector<const Example*>& examples, int iter){
 		ostringstream out;
 		out << "Iteration: " << iter;
 		_checkgrad.check(this, examples, out.str());
@@ -149,9 +299,126 @@ public:
 
 	void loadModel();
 
+	// grows pcg once for the longest of the examples, before any of them is built.
+	// the graphs share the pool, so the callers building graphs on several threads go through here
+	inline void reserve(ComputionGraph* pcg, const vector<const Example*>& examples, int start_pos, int end_pos) {
+		int words_num = 0, chars_num = 0;
+		for (int count = start_pos; count < end_pos; count++) {
+			const Feature& feature = examples[count]->m_feature;
+			if (feature.wordNum() > words_num)
+				words_num = feature.wordNum();
+			if (feature.charNum() > chars_num)
+				chars_num = feature.charNum();
+		}
+		unique_lock<mutex> lock(_reserve_lock);
+		pcg->reserve(words_num, chars_num);
+	}
+
+	inline void reserve(ComputionGraph* pcg, const Feature& feature) {
+		unique_lock<mutex> lock(_reserve_lock);
+		pcg->reserve(feature.wordNum(), feature.charNum());
+	}
 
 
 private:
+	// the nodes first created: enough for the longest sentence of the corpora when _memory knows it
+	inline int sentenceCapacity() const {
+		int length = _memory.maxWords();
+		if (length <= 0)
+			return ComputionGraph::initial_sentence_length;
+		if (length > ComputionGraph::max_sentence_length)
+			return ComputionGraph::max_sentence_length;
+		return length;
+	}
+
+	inline int charCapacity() const {
+		int length = _memory.maxChars();
+		if (length <= 0)
+			return ComputionGraph::initial_char_length;
+		if (length > ComputionGraph::max_char_length)
+			return ComputionGraph::max_char_length;
+		return length;
+	}
+
+	// worker 0 trains on the master parameters, the others on gradient replicas
+	inline void initialWorkers(int nThreads) {
+		if (nThreads < 1)
+			nThreads = 1;
+		_pcgs.push_back(_pcg);
+		_worker_params.push_back(&_modelparams);
+		_replicas.resize(nThreads);
+		_worker_evals.resize(nThreads);
+		_worker_costs.resize(nThreads);
+		for (int idx = 1; idx < nThreads; idx++) {
+			ModelParams* replica = new ModelParams();
+			replica->initialReplica(_modelparams, _hyperparams, &_aligned_mem);
+			ModelUpdate replica_ada;
+			replica->exportModelParams(replica_ada);
+			_memory.addParams(replica_ada);
+			_replicas[idx].bind(_ada, replica_ada);
+			_replicas[idx].bindTable(replica->words, _modelparams.words, replica->word_rows);
+			_replicas[idx].bindTable(replica->chars, _modelparams.chars, replica->char_rows);
+
+			_memory.beginGraphs();
+			ComputionGraph* pcg = new ComputionGraph();
+			pcg->createNodes(sentenceCapacity(), charCapacity(), _hyperparams.cnnLayerSize);
+			pcg->initial(*replica, _hyperparams, &_aligned_mem);
+			_memory.endGraphs();
+			_pcgs.push_back(pcg);
+			_worker_params.push_back(replica);
+		}
+		if (nThreads > 1)
+			_pool.start(nThreads);
+	}
+
+	inline dtype trainWorker(const vector<const Example*>& examples, int worker, int worker_num) {
+		ComputionGraph* pcg = _pcgs[worker];
+		Metric& eval = _worker_evals[worker];
+		eval.reset();
+
+		int example_num = examples.size();
+		int start_pos = worker * example_num / worker_num;
+		int end_pos = (worker + 1) * example_num / worker_num;
+		dtype cost = 0.0;
+
+		reserve(pcg, examples, start_pos, end_pos);
+		for (int count = start_pos; count < end_pos; count++) {
+			const Example& example = *examples[count];
+
+			//forward
+			pcg->forward(example.m_feature, true);
+
+			//loss function
+			cost += _modelparams.loss.loss(&pcg->_output, example.m_label, eval, example_num);
+
+			// backward, which exists only for training 
+			pcg->backward();
+		}
+
+		return cost;
+	}
+
+	inline void predictWorker(ComputionGraph* pcg, const vector<const Example*>& examples, vector<int>& results, int worker, int worker_num,
+		dtype* probs = NULL) {
+		int example_num = examples.size();
+		int start_pos = worker * example_num / worker_num;
+		int end_pos = (worker + 1) * example_num / worker_num;
+		int label_num = _modelparams.labelAlpha.size();
+		reserve(pcg, examples, start_pos, end_pos);
+		for (int count = start_pos; count < end_pos; count++) {
+			pcg->forward(examples[count]->m_feature);
+			if (probs == NULL)
+				_modelparams.loss.predict(&pcg->_output, results[count]);
+			else
+				_modelparams.loss.predict(&pcg->_output, results[count], probs + count * label_num);
+		}
+	}
+
+	inline void touchRows(const Feature& feature) {
+		_sparse_ada.touch(_word_table, feature.wordIds(), feature.wordNum());
+		_sparse_ada.touch(_char_table, feature.charIds(), feature.charNum());
+	}
+
 	inline void resetEval() {
 		_eval.reset();
 	}
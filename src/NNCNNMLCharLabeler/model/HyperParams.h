@@ -4,6 +4,7 @@
 #include "N3L.h"
 #include "Example.h"
 #include "Options.h"
+#include "ModelFile.h"
 
 using namespace nr;
 using namespace std;
@@ -27,6 +28,7 @@ struct HyperParams{
 	int charWindowOutput;
 	int windowHiddenOutput;
 	dtype dropProb;
+	bool parallelBranches; // char branch on its own thread
 
 
 	//auto generated
@@ -38,6 +40,7 @@ struct HyperParams{
 public:
 	HyperParams(){
 		bAssigned = false;
+		parallelBranches = false;
 	}
 
 public:
@@ -54,10 +57,16 @@ public:
 		charContext = opt.charcontext;
 		charHiddenSize = opt.charhiddenSize;
 		dropProb = opt.dropProb;
+		setRuntime(opt);
 
 		bAssigned = true;
 	}
 
+	// execution flags, taken from the options of every run and not stored with the model
+	void setRuntime(Options& opt){
+		parallelBranches = opt.parallelBranches;
+	}
+
 	void clear(){
 		bAssigned = false;
 	}
@@ -67,40 +76,56 @@ public:
 	}
 
 
-	void saveModel(std::ofstream &os) const{
-		os << nnRegular << std::endl;
-		os << adaAlpha << std::endl;
-		os << adaEps << std::endl;
+	void saveModel(ModelWriter& writer) const {
+		writer.write(nnRegular);
+		writer.write(adaAlpha);
+		writer.write(adaEps);
+
+		writer.write(hiddenSize);
+		writer.write(cnnLayerSize);
+		writer.write(wordContext);
+		writer.write(wordWindow);
 
-		os << hiddenSize << std::endl;
-		os << wordContext << std::endl;
-		os << wordWindow << std::endl;
-		os << wordWindowOutput << std::endl;
-		os << dropProb << std::endl;
+		writer.write(charHiddenSize);
+		writer.write(charContext);
+		writer.write(charWindow);
 
+		writer.write(wordWindowOutput);
+		writer.write(charWindowOutput);
+		writer.write(windowHiddenOutput);
+		writer.write(dropProb);
 
-		os << wordDim << std::endl;
-		os << inputSize << std::endl;
-		os << labelSize << std::endl;
+		writer.write(wordDim);
+		writer.write(charDim);
+		writer.write(inputSize);
+		writer.write(labelSize);
 	}
 
-	void loadModel(std::ifstream &is){
-		is >> nnRegular;
-		is >> adaAlpha;
-		is >> adaEps;
+	void loadModel(ModelReader& reader) {
+		reader.read(nnRegular);
+		reader.read(adaAlpha);
+		reader.read(adaEps);
 
-		is >> hiddenSize;
-		is >> wordContext;
-		is >> wordWindow;
-		is >> wordWindowOutput;
-		is >> dropProb;
+		reader.read(hiddenSize);
+		reader.read(cnnLayerSize);
+		reader.read(wordContext);
+		reader.read(wordWindow);
 
+		reader.read(charHiddenSize);
+		reader.read(charContext);
+		reader.read(charWindow);
 
-		is >> wordDim;
-		is >> inputSize;
-		is >> labelSize;
+		reader.read(wordWindowOutput);
+		reader.read(charWindowOutput);
+		reader.read(windowHiddenOutput);
+		reader.read(dropProb);
 
-		bAssigned = true;
+		reader.read(wordDim);
+		reader.read(charDim);
+		reader.read(inputSize);
+		reader.read(labelSize);
+
+		bAssigned = reader.good();
 	}
 public:
 
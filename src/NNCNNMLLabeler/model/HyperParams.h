@@ -4,6 +4,7 @@
 #include "N3L.h"
 #include "Example.h"
 #include "Options.h"
+#include "ModelFile.h"
 
 using namespace nr;
 using namespace std;
@@ -58,40 +59,42 @@ public:
 	}
 
 
-	void saveModel(std::ofstream &os) const{
-		os << nnRegular << std::endl;
-		os << adaAlpha << std::endl;
-		os << adaEps << std::endl;
+	void saveModel(ModelWriter& writer) const {
+		writer.write(nnRegular);
+		writer.write(adaAlpha);
+		writer.write(adaEps);
 
-		os << hiddenSize << std::endl;
-		os << wordContext << std::endl;
-		os << wordWindow << std::endl;
-		os << windowOutput << std::endl;
-		os << dropProb << std::endl;
+		writer.write(hiddenSize);
+		writer.write(cnnLayerSize);
+		writer.write(wordContext);
+		writer.write(wordWindow);
+		writer.write(windowOutput);
+		writer.write(windowHiddenOutput);
+		writer.write(dropProb);
 
-
-		os << wordDim << std::endl;
-		os << inputSize << std::endl;
-		os << labelSize << std::endl;
+		writer.write(wordDim);
+		writer.write(inputSize);
+		writer.write(labelSize);
 	}
 
-	void loadModel(std::ifstream &is){
-		is >> nnRegular;
-		is >> adaAlpha;
-		is >> adaEps;
-
-		is >> hiddenSize;
-		is >> wordContext;
-		is >> wordWindow;
-		is >> windowOutput;
-		is >> dropProb;
+	void loadModel(ModelReader& reader) {
+		reader.read(nnRegular);
+		reader.read(adaAlpha);
+		reader.read(adaEps);
 
+		reader.read(hiddenSize);
+		reader.read(cnnLayerSize);
+		reader.read(wordContext);
+		reader.read(wordWindow);
+		reader.read(windowOutput);
+		reader.read(windowHiddenOutput);
+		reader.read(dropProb);
 
-		is >> wordDim;
-		is >> inputSize;
-		is >> labelSize;
+		reader.read(wordDim);
+		reader.read(inputSize);
+		reader.read(labelSize);
 
-		bAssigned = true;
+		bAssigned = reader.good();
 	}
 public:
 
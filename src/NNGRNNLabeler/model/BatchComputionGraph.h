@@ -0,0 +1,41 @@
+#ifndef SRC_BatchComputionGraph_H_
+#define SRC_BatchComputionGraph_H_
+
+#include "ComputionGraph.h"
+#include "BatchLayers.h"
+
+
+// The graph of ComputionGraph over a whole minibatch, every GRNN step is one GEMM for all sentences.
+struct BatchComputionGraph {
+public:
+	BatchWordWindow _word_window;
+	BatchGRNN _rnn;
+	BatchPooling _pooling;
+	BatchOutput _output;
+
+public:
+	inline void initial(ModelParams& model, HyperParams& opts){
+		_word_window.init(&model.words, opts.wordContext, opts.dropProb, &model.word_rows);
+		_rnn.init(&model.rnn_params, opts.dropProb, true);
+		_output.init(&model.olayer_linear);
+	}
+
+public:
+	inline void forward(const vector<const Feature*>& features, bool bTrain = false){
+		_word_window.forward(features, ComputionGraph::max_sentence_length, bTrain);
+		_rnn.forward(_word_window._outputs, _word_window._lengths, _word_window._steps, bTrain);
+		_pooling.forward(_rnn._hiddens, _word_window._lengths);
+		_output.forward(_pooling._outputs);
+	}
+
+	// call after the loss of every sentence has been set through _output.loss
+	inline void backward(){
+		_output.backward();
+		_pooling._outputs_loss = _output._inputs_loss;
+		_pooling.backward(_rnn._hiddens_loss);
+		_rnn.backward(_word_window._outputs, _word_window._outputs_loss);
+		_word_window.backward();
+	}
+};
+
+#endif /* SRC_BatchComputionGraph_H_ */
@@ -2,29 +2,42 @@
 #define SRC_ComputionGraph_H_
 
 #include "ModelParams.h"
+#include "IdLookupNode.h"
+#include "HoistedRecurrent.h"
 
 
 // Each model consists of two parts, building neural graph and defining output losses.
 struct ComputionGraph : Graph{
 public:
 	const static int max_sentence_length = 2048;
+	// the nodes first created without corpus lengths, reserve() grows them up to the max length on demand
+	const static int initial_sentence_length = 64;
 
 public:
 	// node instances
-	vector<LookupNode> _word_inputs;
+	vector<IdLookupNode> _word_inputs;
 
 	int rnn_layer_size;
-	vector<WindowBuilder> _word_windows;
-	vector<GRNNBuilder> _RNNs;
+	vector<WindowSeqNode> _word_windows;
+	vector<HoistedGRNNBuilder> _RNNs;
 
-	AvgPoolNode _avg_pooling;
-	MaxPoolNode _max_pooling;
-	MinPoolNode _min_pooling;
-
-	ConcatNode _concat;
+	PoolingSeqNode _pooling;
 	LinearNode _output;
+
+	// the lengths the nodes are created for, and what reserve() creates them again with
+	int _sent_capacity;
+	ModelParams* _model;
+	HyperParams* _opts;
+	AlignedMemoryPool* _mem;
+	// a graph that only decodes, whose nodes keep no backward state
+	bool _inference;
 public:
 	ComputionGraph() : Graph(){
+		_sent_capacity = 0;
+		_model = NULL;
+		_opts = NULL;
+		_mem = NULL;
+		_inference = false;
 	}
 
 	~ComputionGraph(){
@@ -34,21 +47,16 @@ public:
 public:
 	//allocate enough nodes 
 	inline void createNodes(int sent_length, int layer_size){
+		_sent_capacity = sent_length;
 		rnn_layer_size = layer_size;
 		_word_inputs.resize(sent_length);
 
 		_word_windows.resize(rnn_layer_size);
 		_RNNs.resize(rnn_layer_size);
-
-		rnn_layer_size = layer_size;
 		for (int idx = 0; idx < rnn_layer_size; idx++) {
-			_word_windows[idx].resize(sent_length);
 			_RNNs[idx].resize(sent_length);
 		}
 
-		_avg_pooling.setParam(sent_length);
-		_max_pooling.setParam(sent_length);
-		_min_pooling.setParam(sent_length);
 	}
 
 	inline void clear(){
@@ -56,7 +64,6 @@ public:
 		_word_inputs.clear();
 
 		for(int idx = 0; idx < rnn_layer_size; idx++){
-			_word_windows[idx].clear();
 			_RNNs[idx].clear();
 		}
 
@@ -65,31 +72,62 @@ public:
 	}
 
 public:
-	inline void initial(ModelParams& model, HyperParams& opts, AlignedMemoryPool* mem = NULL){
+	inline void initial(ModelParams& model, HyperParams& opts, AlignedMemoryPool* mem = NULL, bool inference = false){
+		_model = &model;
+		_opts = &opts;
+		_mem = mem;
+		_inference = inference;
+		initialNodes();
+	}
+
+	// the nodes of createNodes(), with the params and pool given to initial()
+	inline void initialNodes(){
+		ModelParams& model = *_model;
+		HyperParams& opts = *_opts;
+		AlignedMemoryPool* mem = _mem;
 		for (int idx = 0; idx < _word_inputs.size(); idx++) {
-			_word_inputs[idx].setParam(&model.words);
-			_word_inputs[idx].init(opts.wordDim, opts.dropProb, mem);
+			_word_inputs[idx].setParam(&model.words, &model.word_rows);
+			_word_inputs[idx].init(opts.wordDim, opts.dropProb, mem, _inference);
 		}
 
 		for (int idy = 0; idy < rnn_layer_size; idy++) {
-			_RNNs[idy].init(&model.rnn_params[idy], opts.dropProb, true, mem);
+			_RNNs[idy].init(&model.rnn_params[idy], opts.dropProb, true, mem, opts.hoistRNN, _inference);
 		}
 
-		_word_windows[0].init(opts.wordDim, opts.wordContext, mem);
+		_word_windows[0].init(opts.wordDim, opts.wordContext);
 		for (int idy = 1; idy < rnn_layer_size; idy++) {
-			_word_windows[idy].init(opts.hiddenSize, opts.wordContext, mem);
+			_word_windows[idy].init(opts.hiddenSize, opts.wordContext);
 		}
 
-		_avg_pooling.init(opts.hiddenSize, -1, mem);
-		_max_pooling.init(opts.hiddenSize, -1, mem);
-		_min_pooling.init(opts.hiddenSize, -1, mem);
-		_concat.init(opts.hiddenSize * 3, -1, mem);
+		_pooling.init(opts.hiddenSize, -1, mem, _inference);
 		_output.setParam(&model.olayer_linear);
 		_output.init(opts.labelSize, -1, mem);
 	}
 
 
 public:
+	// grows the nodes to hold words_num words, doubling the length they are created for
+	// so that a corpus causes few rebuilds. the Driver calls it before a block of sentences is built,
+	// never inside forward(); the grown nodes come from the pool of the graph.
+	inline void reserve(int words_num){
+		if (words_num > max_sentence_length)
+			words_num = max_sentence_length;
+		if (words_num <= _sent_capacity || _model == NULL)
+			return;
+
+		int sent_length = _sent_capacity > 0 ? _sent_capacity : 1;
+		while (sent_length < words_num)
+			sent_length *= 2;
+		if (sent_length > max_sentence_length)
+			sent_length = max_sentence_length;
+
+		// the graph drops its pointers to the nodes of the last sentence before they are destroyed
+		clearValue();
+		clear();
+		createNodes(sent_length, rnn_layer_size);
+		initialNodes();
+	}
+
 	// some nodes may behave different during training and decode, for example, dropout
 	inline void forward(const Feature& feature, bool bTrain = false){
 		//first step: clear value
@@ -97,28 +135,24 @@ public:
 
 		// second step: build graph
 		//forward
-		int words_num = feature.m_tweet_words.size();
-		if (words_num > max_sentence_length)
-			words_num = max_sentence_length;
+		int words_num = feature.wordNum();
+		if (words_num > _sent_capacity)
+			words_num = _sent_capacity;
 		for (int i = 0; i < words_num; i++) {
-			_word_inputs[i].forward(this, feature.m_tweet_words[i]);
+			_word_inputs[i].forward(this, feature.wordIds()[i]);
 		}
 		_word_windows[0].forward(this, getPNodes(_word_inputs, words_num));
 
-		_RNNs[0].forward(this, getPNodes(_word_windows[0]._outputs, words_num));
+		_RNNs[0].forward(this, &_word_windows[0]);
 
 		for(int i = 1; i < rnn_layer_size; i++){
-			_word_windows[i].forward(this, getPNodes(_RNNs[i - 1]._output, words_num));
+			_word_windows[i].forward(this, _RNNs[i - 1].output());
 
-			_RNNs[i].forward(this, getPNodes(_word_windows[i]._outputs, words_num));
+			_RNNs[i].forward(this, &_word_windows[i]);
 		}
 
-		_avg_pooling.forward(this, getPNodes(_RNNs[rnn_layer_size - 1]._output, words_num));
-		_max_pooling.forward(this, getPNodes(_RNNs[rnn_layer_size - 1]._output, words_num));
-		_min_pooling.forward(this, getPNodes(_RNNs[rnn_layer_size - 1]._output, words_num));
-
-		_concat.forward(this, &_avg_pooling, &_max_pooling, &_min_pooling);
-		_output.forward(this, &_concat);
+		_pooling.forward(this, _RNNs[rnn_layer_size - 1].output());
+		_output.forward(this, &_pooling);
 	}
 };
 
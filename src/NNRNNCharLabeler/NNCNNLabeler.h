@@ -9,6 +9,11 @@
 #include "Example.h"
 #include "Pipe.h"
 #include "Utf.h"
+#include "BucketSampler.h"
+#include "EmbeddingLoader.h"
+#include "AlphabetBuilder.h"
+#include "InferenceServer.h"
+#include "StreamDecoder.h"
 
 using namespace nr;
 using namespace std;
@@ -43,13 +48,19 @@ public:
 
 	void convert2Example(const Instance* pInstance, Example& exam);
 	void initialExamples(const vector<Instance>& vecInsts, vector<Example>& vecExams);
+	void initialIds(vector<Example>& vecExams);
 
 public:
 	void train(const string& trainFile, const string& devFile, const string& testFile, const string& modelFile, const string& optionFile);
 	int predict(const Feature& feature, string& output);
-	void test(const string& testFile, const string& outputFile, const string& modelFile);
+	void predict(const vector<const Example*>& examples, vector<string>& outputs);
+	void assignLabels(const vector<int>& labelIdxs, vector<string>& outputs);
+	void test(const string& testFile, const string& outputFile, const string& modelFile, const string& optionFile);
+	void serve(const string& modelFile, const string& optionFile, const string& socketFile);
+	void serveBatch(const vector<string>& requests, vector<string>& responses);
 
 	void writeModelFile(const string& outputModelFile);
+	void writeModelFile(const string& outputModelFile, const ModelParams& params);
 	void loadModelFile(const string& inputModelFile);
 
 };
@@ -0,0 +1,105 @@
+#ifndef _ALPHABET_BUILDER_H_
+#define _ALPHABET_BUILDER_H_
+
+#include "N3L.h"
+#include "Instance.h"
+#include "Utf.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+/*
+ the word, char and label counts of createAlphabet/addTestAlpha.
+ every thread normalizes and counts a contiguous range of instances on its own,
+ remembering the elements in the order they first occur in its range.
+ the ranges are merged in order, so the stats see the same first insertions as a
+ serial pass over the instances, and the alphabets built from them stay the same.
+ */
+class AlphabetBuilder {
+public:
+	AlphabetBuilder(int nThreads = 1) {
+		_threads = nThreads < 1 ? 1 : nThreads;
+	}
+
+public:
+	// counts the first num instances, NULL stats or labels are not collected
+	void count(const vector<Instance>& vecInsts, int num, unordered_map<string, int>* word_stats,
+		unordered_map<string, int>* char_stats, vector<string>* labels) {
+		int threads = num < _threads ? num : _threads;
+		if (threads <= 0)
+			return;
+		vector<Counts> words(threads), chars(threads), label_counts(threads);
+		ThreadPool pool;
+		if (threads > 1)
+			pool.start(threads);
+		pool.run(threads, [&](int range) {
+			int start = num * range / threads, end = num * (range + 1) / threads;
+			string curword, curchar;
+			vector<int> offsets;
+			for (int idx = start; idx < end; idx++) {
+				const Instance& inst = vecInsts[idx];
+				if (labels != NULL)
+					label_counts[range].add(inst.m_label);
+				if (word_stats == NULL && char_stats == NULL)
+					continue;
+				for (int idy = 0; idy < inst.m_tweet.size(); idy++) {
+					normalize_to_lowerwithdigit(inst.m_tweet[idy], curword);
+					if (word_stats != NULL)
+						words[range].add(curword);
+					if (char_stats == NULL)
+						continue;
+					// the chars of a normalized word are normalized already
+					int chars_num = getUTF8CharOffsets(curword.data(), curword.size(), offsets);
+					for (int idz = 0; idz < chars_num; idz++) {
+						curchar.assign(curword, offsets[idz], offsets[idz + 1] - offsets[idz]);
+						chars[range].add(curchar);
+					}
+				}
+			}
+		});
+
+		for (int range = 0; range < threads; range++) {
+			if (word_stats != NULL)
+				words[range].merge(*word_stats);
+			if (char_stats != NULL)
+				chars[range].merge(*char_stats);
+			if (labels != NULL)
+				label_counts[range].merge(*labels);
+		}
+	}
+
+private:
+	// counts of one range, in the order of first occurrence
+	struct Counts {
+		unordered_map<string, int> index;
+		vector<string> elems;
+		vector<int> counts;
+
+		void add(const string& elem) {
+			unordered_map<string, int>::iterator it = index.find(elem);
+			if (it != index.end()) {
+				counts[it->second]++;
+				return;
+			}
+			index[elem] = elems.size();
+			elems.push_back(elem);
+			counts.push_back(1);
+		}
+
+		void merge(unordered_map<string, int>& stats) const {
+			for (int idx = 0; idx < elems.size(); idx++)
+				stats[elems[idx]] += counts[idx];
+		}
+
+		// the distinct elements, those of earlier ranges first
+		void merge(vector<string>& distinct) const {
+			for (int idx = 0; idx < elems.size(); idx++)
+				distinct.push_back(elems[idx]);
+		}
+	};
+
+private:
+	int _threads;
+};
+
+#endif /*_ALPHABET_BUILDER_H_*/
@@ -0,0 +1,268 @@
+#ifndef _BATCH_LAYERS_H_
+#define _BATCH_LAYERS_H_
+
+#include "BatchRecurrent.h"
+#include "Example.h"
+#include "SparseRows.h"
+
+using namespace std;
+
+/*
+ the non-recurrent layers of a padded minibatch, see BatchRecurrent.h for the layout.
+ they follow LookupNode + WindowBuilder, Avg/Max/MinPoolNode + ConcatNode,
+ and LinearNode + SoftMaxLoss of the per-sentence graphs.
+ */
+
+// word lookup with dropout followed by the context window
+class BatchWordWindow {
+public:
+	LookupTable* _param;
+	SparseRows* _rows; // gradients of a replica table, see SparseRows.h
+	int _context;
+	int _window;
+	int _dim;
+	dtype _drop_value;
+
+	int _batch;
+	int _steps;
+	vector<int> _lengths;
+	vector<int> _ids; // -1 for padding and unmodeled words
+	BatchMat _embs;
+	BatchMat _drop_masks;
+	mt19937 _generator;
+	BatchMat _outputs; // dim * window rows: the word itself, then left and right context
+	BatchMat _outputs_loss;
+
+public:
+	BatchWordWindow() {
+		_param = NULL;
+		_rows = NULL;
+		_context = _window = _dim = 0;
+		_batch = _steps = 0;
+		_drop_value = -1;
+	}
+
+	inline void init(LookupTable* paramInit, int context, dtype dropout, SparseRows* rows = NULL) {
+		_param = paramInit;
+		_rows = rows;
+		_dim = _param->nDim;
+		_context = context;
+		_window = 2 * context + 1;
+		_drop_value = dropout;
+		_generator.seed(rand());
+	}
+
+	inline void forward(const vector<const Feature*>& features, int max_length, bool bTrain) {
+		_batch = features.size();
+		_lengths.resize(_batch);
+		_steps = 0;
+		for (int idx = 0; idx < _batch; idx++) {
+			int words_num = features[idx]->wordNum();
+			_lengths[idx] = words_num > max_length ? max_length : words_num;
+			if (_lengths[idx] > _steps)
+				_steps = _lengths[idx];
+		}
+
+		int B = _batch;
+		_ids.assign(_steps * B, -1);
+		_embs.setZero(_dim, _steps * B);
+		for (int idx = 0; idx < B; idx++) {
+			const int* word_ids = features[idx]->wordIds();
+			for (int step = 0; step < _lengths[idx]; step++) {
+				int xid = word_ids[step];
+				if (xid < 0)
+					xid = _param->nUNKId;
+				_ids[step * B + idx] = xid;
+				if (xid >= 0)
+					_embs.col(step * B + idx) = Eigen::Map<const BatchMat>(_param->E.val[xid], _dim, 1);
+			}
+		}
+		if (_drop_value > 0 && bTrain) {
+			batchDropMask(_drop_masks, _dim, _steps * B, _drop_value, _generator);
+			_embs = _embs.cwiseProduct(_drop_masks);
+		}
+		else if (_drop_value > 0) {
+			_embs *= (1 - _drop_value);
+		}
+
+		_outputs.setZero(_dim * _window, _steps * B);
+		for (int idx = 0; idx < B; idx++) {
+			for (int step = 0; step < _lengths[idx]; step++) {
+				int col = step * B + idx;
+				for (int offset = 0; offset < _window; offset++) {
+					int pos = position(step, offset);
+					if (pos >= 0 && pos < _lengths[idx])
+						_outputs.block(offset * _dim, col, _dim, 1) = _embs.col(pos * B + idx);
+				}
+			}
+		}
+		_outputs_loss.setZero(_dim * _window, _steps * B);
+	}
+
+	inline void backward() {
+		if (!_param->bFineTune)
+			return;
+		int B = _batch;
+		BatchMat embs_loss = BatchMat::Zero(_dim, _steps * B);
+		for (int idx = 0; idx < B; idx++) {
+			for (int step = 0; step < _lengths[idx]; step++) {
+				int col = step * B + idx;
+				for (int offset = 0; offset < _window; offset++) {
+					int pos = position(step, offset);
+					if (pos >= 0 && pos < _lengths[idx])
+						embs_loss.col(pos * B + idx) += _outputs_loss.block(offset * _dim, col, _dim, 1);
+				}
+			}
+		}
+		if (_drop_value > 0)
+			embs_loss = embs_loss.cwiseProduct(_drop_masks);
+
+		for (int col = 0; col < _steps * B; col++) {
+			int xid = _ids[col];
+			if (xid < 0)
+				continue;
+			if (_rows != NULL && _rows->active()) {
+				_rows->add(xid, embs_loss.col(col).data());
+				continue;
+			}
+			_param->E.indexers[xid] = true;
+			Eigen::Map<BatchMat>(_param->E.grad[xid], _dim, 1) += embs_loss.col(col);
+		}
+	}
+
+private:
+	// sentence position feeding window block offset of step
+	inline int position(int step, int offset) const {
+		if (offset == 0)
+			return step;
+		if (offset <= _context)
+			return step - offset;
+		return step + offset - _context;
+	}
+};
+
+// concatenated average, max and min pooling over the real tokens of every sentence
+class BatchPooling {
+public:
+	int _dim;
+	int _batch;
+	vector<int> _lengths;
+	vector<int> _max_steps;
+	vector<int> _min_steps;
+	BatchMat _outputs; // 3 * dim rows
+	BatchMat _outputs_loss;
+
+public:
+	BatchPooling() {
+		_dim = _batch = 0;
+	}
+
+	inline void forward(const BatchMat& x, const vector<int>& lengths) {
+		_dim = x.rows();
+		_batch = lengths.size();
+		_lengths = lengths;
+		int B = _batch;
+		_outputs.setZero(3 * _dim, B);
+		_max_steps.assign(_dim * B, -1);
+		_min_steps.assign(_dim * B, -1);
+		for (int idx = 0; idx < B; idx++) {
+			if (_lengths[idx] == 0)
+				continue;
+			for (int idy = 0; idy < _dim; idy++) {
+				dtype sum = 0;
+				int max_step = 0, min_step = 0;
+				for (int step = 0; step < _lengths[idx]; step++) {
+					dtype value = x(idy, step * B + idx);
+					sum += value;
+					if (value > x(idy, max_step * B + idx))
+						max_step = step;
+					if (value < x(idy, min_step * B + idx))
+						min_step = step;
+				}
+				_outputs(idy, idx) = sum / _lengths[idx];
+				_outputs(_dim + idy, idx) = x(idy, max_step * B + idx);
+				_outputs(2 * _dim + idy, idx) = x(idy, min_step * B + idx);
+				_max_steps[idx * _dim + idy] = max_step;
+				_min_steps[idx * _dim + idy] = min_step;
+			}
+		}
+		_outputs_loss.setZero(3 * _dim, B);
+	}
+
+	// adds the loss of the pooled values into x_loss
+	inline void backward(BatchMat& x_loss) {
+		int B = _batch;
+		for (int idx = 0; idx < B; idx++) {
+			if (_lengths[idx] == 0)
+				continue;
+			for (int idy = 0; idy < _dim; idy++) {
+				dtype avg_loss = _outputs_loss(idy, idx) / _lengths[idx];
+				for (int step = 0; step < _lengths[idx]; step++)
+					x_loss(idy, step * B + idx) += avg_loss;
+				x_loss(idy, _max_steps[idx * _dim + idy] * B + idx) += _outputs_loss(_dim + idy, idx);
+				x_loss(idy, _min_steps[idx * _dim + idy] * B + idx) += _outputs_loss(2 * _dim + idy, idx);
+			}
+		}
+	}
+};
+
+// the output layer and its softmax loss, one column per sentence
+class BatchOutput {
+public:
+	UniParams* _param;
+	BatchMat _inputs;
+	BatchMat _inputs_loss;
+	BatchMat _outputs;
+	BatchMat _outputs_loss;
+
+public:
+	BatchOutput() {
+		_param = NULL;
+	}
+
+	inline void init(UniParams* paramInit) {
+		_param = paramInit;
+	}
+
+	inline void forward(const BatchMat& x) {
+		_inputs = x;
+		_outputs.noalias() = _param->W.val.mat() * x;
+		if (_param->bUseB)
+			_outputs.colwise() += _param->b.val.mat().col(0);
+		_outputs_loss.setZero(_outputs.rows(), _outputs.cols());
+	}
+
+	// the same cost, gradient and evaluation as IdSoftMaxLoss::loss
+	inline dtype loss(int idx, int answer, Metric& eval, int batchsize = 1) {
+		int nDim = _outputs.rows();
+		int optLabel = 0;
+		for (int i = 1; i < nDim; ++i) {
+			if (_outputs(i, idx) > _outputs(optLabel, idx))
+				optLabel = i;
+		}
+
+		dtype sum1 = 0, sum2 = 0, maxScore = _outputs(optLabel, idx);
+		for (int i = 0; i < nDim; ++i) {
+			_outputs_loss(i, idx) = exp(_outputs(i, idx) - maxScore);
+			sum2 += _outputs_loss(i, idx);
+		}
+		if (answer >= 0 && answer < nDim)
+			sum1 = _outputs_loss(answer, idx);
+		if (optLabel == answer)
+			eval.correct_label_count++;
+		eval.overall_label_count++;
+
+		for (int i = 0; i < nDim; ++i)
+			_outputs_loss(i, idx) = (_outputs_loss(i, idx) / sum2 - (i == answer ? 1 : 0)) / batchsize;
+		return (log(sum2) - log(sum1)) / batchsize;
+	}
+
+	inline void backward() {
+		_param->W.grad.mat().noalias() += _outputs_loss * _inputs.transpose();
+		if (_param->bUseB)
+			_param->b.grad.mat().col(0) += _outputs_loss.rowwise().sum();
+		_inputs_loss.noalias() = _param->W.val.mat().transpose() * _outputs_loss;
+	}
+};
+
+#endif /*_BATCH_LAYERS_H_*/
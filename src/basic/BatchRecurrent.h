@@ -0,0 +1,497 @@
+#ifndef _BATCH_RECURRENT_H_
+#define _BATCH_RECURRENT_H_
+
+#include <random>
+#include "N3L.h"
+
+using namespace std;
+
+/*
+ recurrent layers over a padded minibatch.
+ a batch of B sequences of at most T steps is stored column-wise, step t of
+ sequence b being column t * B + b, so every step is one GEMM over the batch.
+ steps beyond the length of a sequence are masked: they carry the previous state,
+ which keeps the state of a right-to-left pass zero until its last real token.
+ */
+typedef Eigen::Matrix<dtype, Eigen::Dynamic, Eigen::Dynamic> BatchMat;
+typedef Eigen::Matrix<dtype, 1, Eigen::Dynamic> BatchRow;
+
+inline void batchSigmoid(BatchMat& x) {
+	x = (1.0 + (-x.array()).exp()).inverse().matrix();
+}
+
+inline void batchTanh(BatchMat& x) {
+	x = x.array().tanh().matrix();
+}
+
+// the same exact-count masks as Node::forward_drop, one column per token.
+// every layer shuffles with its own generator, seeded from rand() at init,
+// so masks do not depend on which thread runs the layer.
+inline void batchDropMask(BatchMat& mask, int rows, int cols, dtype drop_value, mt19937& generator) {
+	mask.setOnes(rows, cols);
+	int dropNum = (int)(rows * drop_value);
+	vector<int> tmp_masks(rows);
+	for (int col = 0; col < cols; col++) {
+		for (int idx = 0; idx < rows; idx++)
+			tmp_masks[idx] = idx < dropNum ? 0 : 1;
+		shuffle(tmp_masks.begin(), tmp_masks.end(), generator);
+		for (int idx = 0; idx < rows; idx++)
+			mask(idx, col) = tmp_masks[idx];
+	}
+}
+
+// proj = W2 * x + b over all columns at once, the input part of a step does not depend on the recurrence
+inline void batchProject(BiParams& param, const BatchMat& x, BatchMat& proj) {
+	proj.noalias() = param.W2.val.mat() * x;
+	if (param.bUseB)
+		proj.colwise() += param.b.val.mat().col(0);
+}
+
+// out = W1 * h + proj, the sequential part of a step
+inline void batchRecur(BiParams& param, const BatchMat& h, const Eigen::Ref<const BatchMat>& proj, BatchMat& out) {
+	out = proj;
+	out.noalias() += param.W1.val.mat() * h;
+}
+
+// gradients of batchRecur for the pre-activation loss dout
+inline void batchRecurBackward(BiParams& param, const BatchMat& h, const BatchMat& dout, BatchMat& dh) {
+	param.W1.grad.mat().noalias() += dout * h.transpose();
+	dh.noalias() += param.W1.val.mat().transpose() * dout;
+}
+
+// gradients of batchProject for the pre-activation losses of all steps
+inline void batchProjectBackward(BiParams& param, const BatchMat& x, const BatchMat& dproj, BatchMat& x_loss) {
+	param.W2.grad.mat().noalias() += dproj * x.transpose();
+	if (param.bUseB)
+		param.b.grad.mat().col(0) += dproj.rowwise().sum();
+	x_loss.noalias() += param.W2.val.mat().transpose() * dproj;
+}
+
+class BatchRecurrent {
+public:
+	int _outDim;
+	int _inDim;
+	int _batch;
+	int _steps;
+	dtype _drop_value;
+	bool _left2right;
+
+	vector<BatchRow> _masks; // 1 for real tokens, one row per step
+	BatchMat _hiddens; // outputs after dropout
+	BatchMat _hiddens_loss; // filled by the layers above before backward
+	BatchMat _drop_masks;
+	mt19937 _generator;
+
+public:
+	BatchRecurrent() {
+		_outDim = _inDim = _batch = _steps = 0;
+		_drop_value = -1;
+		_left2right = true;
+	}
+
+	virtual ~BatchRecurrent() {
+	}
+
+protected:
+	// the losses and drop masks are only for backward, a decoding forward leaves them alone
+	inline void setBatch(const vector<int>& lengths, int steps, bool bTrain) {
+		_batch = lengths.size();
+		_steps = steps;
+		_masks.resize(_steps);
+		for (int step = 0; step < _steps; step++) {
+			_masks[step].resize(_batch);
+			for (int idx = 0; idx < _batch; idx++)
+				_masks[step](idx) = step < lengths[idx] ? 1 : 0;
+		}
+		_hiddens.setZero(_outDim, _steps * _batch);
+		if (bTrain) {
+			_hiddens_loss.setZero(_outDim, _steps * _batch);
+			if (_drop_value > 0)
+				_drop_masks.setOnes(_outDim, _steps * _batch);
+		}
+	}
+
+	// processing order of the steps
+	inline int stepAt(int order) const {
+		return _left2right ? order : _steps - 1 - order;
+	}
+
+	inline int prevStep(int step) const {
+		return _left2right ? step - 1 : step + 1;
+	}
+
+	// keeps the previous state in masked columns
+	inline void carry(BatchMat& state, const BatchMat& prev, int step) const {
+		for (int idx = 0; idx < _batch; idx++) {
+			if (_masks[step](idx) == 0)
+				state.col(idx) = prev.col(idx);
+		}
+	}
+
+	// dropout on the output of one step, masked columns keep the previous state
+	inline void dropStep(BatchMat& hidden, const BatchMat& prev, int step, bool bTrain) {
+		int B = _batch;
+		if (_drop_value > 0 && bTrain) {
+			BatchMat mask;
+			batchDropMask(mask, _outDim, B, _drop_value, _generator);
+			_drop_masks.middleCols(step * B, B) = mask;
+			hidden = hidden.cwiseProduct(mask);
+		}
+		else if (_drop_value > 0) {
+			hidden *= (1 - _drop_value);
+		}
+		carry(hidden, prev, step);
+	}
+
+	// loss of the step output before dropout
+	inline void dropStepBackward(const BatchMat& dout, BatchMat& dhidden, int step) const {
+		if (_drop_value > 0)
+			dhidden = dout.cwiseProduct(_drop_masks.middleCols(step * _batch, _batch));
+		else
+			dhidden = dout;
+	}
+
+	// masked columns hand their loss straight to the previous state
+	inline void passMasked(BatchMat& dprev, const BatchMat& dout, int step) const {
+		for (int idx = 0; idx < _batch; idx++) {
+			if (_masks[step](idx) == 0)
+				dprev.col(idx) = dout.col(idx);
+		}
+	}
+
+	inline void zeroMasked(BatchMat& grad, int step) const {
+		for (int idx = 0; idx < _batch; idx++) {
+			if (_masks[step](idx) == 0)
+				grad.col(idx).setZero();
+		}
+	}
+};
+
+class BatchRNN : public BatchRecurrent {
+public:
+	RNNParams* _param;
+
+	BatchMat _results; // input projections until forward overwrites them step by step
+	BatchMat _results_loss;
+
+public:
+	BatchRNN() {
+		_param = NULL;
+	}
+
+	inline void init(RNNParams* paramInit, dtype dropout, bool left2right = true) {
+		_param = paramInit;
+		_outDim = _param->_rnn.W1.outDim();
+		_inDim = _param->_rnn.W2.inDim();
+		_drop_value = dropout;
+		_left2right = left2right;
+		_generator.seed(rand());
+	}
+
+	// x: inDim * (steps * batch)
+	inline void forward(const BatchMat& x, const vector<int>& lengths, int steps, bool bTrain) {
+		setBatch(lengths, steps, bTrain);
+		int B = _batch;
+		batchProject(_param->_rnn, x, _results);
+
+		BatchMat prev = BatchMat::Zero(_outDim, B), pre, hidden;
+		for (int order = 0; order < _steps; order++) {
+			int step = stepAt(order);
+			if (order > 0)
+				prev = _hiddens.middleCols(prevStep(step) * B, B);
+
+			batchRecur(_param->_rnn, prev, _results.middleCols(step * B, B), pre);
+			batchTanh(pre);
+			_results.middleCols(step * B, B) = pre;
+
+			hidden = pre;
+			dropStep(hidden, prev, step, bTrain);
+			_hiddens.middleCols(step * B, B) = hidden;
+		}
+	}
+
+	// accumulates parameter gradients and adds the input loss into x_loss
+	inline void backward(const BatchMat& x, BatchMat& x_loss) {
+		int B = _batch;
+		BatchMat ones = BatchMat::Ones(_outDim, B);
+		BatchMat prev, dout, dprev, dhidden, dresult;
+		BatchMat carried = BatchMat::Zero(_outDim, B);
+		_results_loss.setZero(_outDim, _steps * B);
+		for (int order = _steps - 1; order >= 0; order--) {
+			int step = stepAt(order);
+			if (order > 0)
+				prev = _hiddens.middleCols(prevStep(step) * B, B);
+			else
+				prev.setZero(_outDim, B);
+
+			dout = _hiddens_loss.middleCols(step * B, B) + carried;
+			dropStepBackward(dout, dhidden, step);
+			const BatchMat& result = _results.middleCols(step * B, B);
+			dresult = dhidden.cwiseProduct(ones - result.cwiseProduct(result));
+			zeroMasked(dresult, step);
+			_results_loss.middleCols(step * B, B) = dresult;
+
+			dprev.setZero(_outDim, B);
+			passMasked(dprev, dout, step);
+			batchRecurBackward(_param->_rnn, prev, dresult, dprev);
+
+			carried = dprev;
+		}
+		batchProjectBackward(_param->_rnn, x, _results_loss, x_loss);
+	}
+};
+
+class BatchGRNN : public BatchRecurrent {
+public:
+	GRNNParams* _param;
+
+	// input projections until forward overwrites them step by step
+	BatchMat _update_gates;
+	BatchMat _reset_gates;
+	BatchMat _results;
+
+	BatchMat _update_gates_loss;
+	BatchMat _reset_gates_loss;
+	BatchMat _results_loss;
+
+public:
+	BatchGRNN() {
+		_param = NULL;
+	}
+
+	inline void init(GRNNParams* paramInit, dtype dropout, bool left2right = true) {
+		_param = paramInit;
+		_outDim = _param->_rnn.W1.outDim();
+		_inDim = _param->_rnn.W2.inDim();
+		_drop_value = dropout;
+		_left2right = left2right;
+		_generator.seed(rand());
+	}
+
+	// x: inDim * (steps * batch)
+	inline void forward(const BatchMat& x, const vector<int>& lengths, int steps, bool bTrain) {
+		setBatch(lengths, steps, bTrain);
+		int B = _batch;
+		batchProject(_param->_rnn_update, x, _update_gates);
+		batchProject(_param->_rnn_reset, x, _reset_gates);
+		batchProject(_param->_rnn, x, _results);
+
+		BatchMat prev = BatchMat::Zero(_outDim, B), pre, mult, hidden;
+		for (int order = 0; order < _steps; order++) {
+			int step = stepAt(order);
+			if (order > 0)
+				prev = _hiddens.middleCols(prevStep(step) * B, B);
+
+			batchRecur(_param->_rnn_update, prev, _update_gates.middleCols(step * B, B), pre);
+			batchSigmoid(pre);
+			_update_gates.middleCols(step * B, B) = pre;
+
+			batchRecur(_param->_rnn_reset, prev, _reset_gates.middleCols(step * B, B), pre);
+			batchSigmoid(pre);
+			_reset_gates.middleCols(step * B, B) = pre;
+
+			mult = pre.cwiseProduct(prev);
+			batchRecur(_param->_rnn, mult, _results.middleCols(step * B, B), pre);
+			batchTanh(pre);
+			_results.middleCols(step * B, B) = pre;
+
+			const BatchMat& z = _update_gates.middleCols(step * B, B);
+			hidden = z.cwiseProduct(pre) + (BatchMat::Ones(_outDim, B) - z).cwiseProduct(prev);
+			dropStep(hidden, prev, step, bTrain);
+			_hiddens.middleCols(step * B, B) = hidden;
+		}
+	}
+
+	// accumulates parameter gradients and adds the input loss into x_loss
+	inline void backward(const BatchMat& x, BatchMat& x_loss) {
+		int B = _batch;
+		BatchMat ones = BatchMat::Ones(_outDim, B);
+		BatchMat prev, dout, dprev, dhidden, dz, dresult, dmult, dreset, mult;
+		BatchMat carried = BatchMat::Zero(_outDim, B);
+		_update_gates_loss.setZero(_outDim, _steps * B);
+		_reset_gates_loss.setZero(_outDim, _steps * B);
+		_results_loss.setZero(_outDim, _steps * B);
+		for (int order = _steps - 1; order >= 0; order--) {
+			int step = stepAt(order);
+			if (order > 0)
+				prev = _hiddens.middleCols(prevStep(step) * B, B);
+			else
+				prev.setZero(_outDim, B);
+
+			dout = _hiddens_loss.middleCols(step * B, B) + carried;
+			dropStepBackward(dout, dhidden, step);
+			const BatchMat& z = _update_gates.middleCols(step * B, B);
+			const BatchMat& r = _reset_gates.middleCols(step * B, B);
+			const BatchMat& result = _results.middleCols(step * B, B);
+
+			dz = dhidden.cwiseProduct(result - prev).cwiseProduct(z.cwiseProduct(ones - z));
+			dresult = dhidden.cwiseProduct(z).cwiseProduct(ones - result.cwiseProduct(result));
+			zeroMasked(dz, step);
+			zeroMasked(dresult, step);
+			_update_gates_loss.middleCols(step * B, B) = dz;
+			_results_loss.middleCols(step * B, B) = dresult;
+
+			dprev = dhidden.cwiseProduct(ones - z);
+			passMasked(dprev, dout, step);
+
+			mult = r.cwiseProduct(prev);
+			dmult.setZero(_outDim, B);
+			batchRecurBackward(_param->_rnn, mult, dresult, dmult);
+			dreset = dmult.cwiseProduct(prev).cwiseProduct(r.cwiseProduct(ones - r));
+			_reset_gates_loss.middleCols(step * B, B) = dreset;
+			dprev += dmult.cwiseProduct(r);
+
+			batchRecurBackward(_param->_rnn_reset, prev, dreset, dprev);
+			batchRecurBackward(_param->_rnn_update, prev, dz, dprev);
+
+			carried = dprev;
+		}
+		batchProjectBackward(_param->_rnn_update, x, _update_gates_loss, x_loss);
+		batchProjectBackward(_param->_rnn_reset, x, _reset_gates_loss, x_loss);
+		batchProjectBackward(_param->_rnn, x, _results_loss, x_loss);
+	}
+};
+
+class BatchLSTM : public BatchRecurrent {
+public:
+	LSTMParams* _param;
+
+	// input projections until forward overwrites them step by step
+	BatchMat _input_gates;
+	BatchMat _forget_gates;
+	BatchMat _output_gates;
+	BatchMat _half_cells;
+	BatchMat _cells;
+
+	BatchMat _input_gates_loss;
+	BatchMat _forget_gates_loss;
+	BatchMat _output_gates_loss;
+	BatchMat _half_cells_loss;
+
+public:
+	BatchLSTM() {
+		_param = NULL;
+	}
+
+	inline void init(LSTMParams* paramInit, dtype dropout, bool left2right = true) {
+		_param = paramInit;
+		_outDim = _param->cell.W1.outDim();
+		_inDim = _param->cell.W2.inDim();
+		_drop_value = dropout;
+		_left2right = left2right;
+		_generator.seed(rand());
+	}
+
+	inline void forward(const BatchMat& x, const vector<int>& lengths, int steps, bool bTrain) {
+		setBatch(lengths, steps, bTrain);
+		int B = _batch;
+		batchProject(_param->input, x, _input_gates);
+		batchProject(_param->forget, x, _forget_gates);
+		batchProject(_param->output, x, _output_gates);
+		batchProject(_param->cell, x, _half_cells);
+		// the cells of all steps are kept for backward, decoding only needs the last one
+		if (bTrain)
+			_cells.setZero(_outDim, _steps * B);
+
+		BatchMat prev = BatchMat::Zero(_outDim, B), prev_cell = BatchMat::Zero(_outDim, B);
+		BatchMat pre, cell, hidden;
+		for (int order = 0; order < _steps; order++) {
+			int step = stepAt(order);
+			if (order > 0)
+				prev = _hiddens.middleCols(prevStep(step) * B, B);
+
+			batchRecur(_param->input, prev, _input_gates.middleCols(step * B, B), pre);
+			batchSigmoid(pre);
+			_input_gates.middleCols(step * B, B) = pre;
+
+			batchRecur(_param->forget, prev, _forget_gates.middleCols(step * B, B), pre);
+			batchSigmoid(pre);
+			_forget_gates.middleCols(step * B, B) = pre;
+
+			batchRecur(_param->output, prev, _output_gates.middleCols(step * B, B), pre);
+			batchSigmoid(pre);
+			_output_gates.middleCols(step * B, B) = pre;
+
+			batchRecur(_param->cell, prev, _half_cells.middleCols(step * B, B), pre);
+			batchTanh(pre);
+			_half_cells.middleCols(step * B, B) = pre;
+
+			cell = _input_gates.middleCols(step * B, B).cwiseProduct(pre)
+				+ _forget_gates.middleCols(step * B, B).cwiseProduct(prev_cell);
+			carry(cell, prev_cell, step);
+			if (bTrain)
+				_cells.middleCols(step * B, B) = cell;
+
+			hidden = _output_gates.middleCols(step * B, B).cwiseProduct(cell.array().tanh().matrix());
+			dropStep(hidden, prev, step, bTrain);
+			_hiddens.middleCols(step * B, B) = hidden;
+			prev_cell = cell;
+		}
+	}
+
+	inline void backward(const BatchMat& x, BatchMat& x_loss) {
+		int B = _batch;
+		BatchMat prev, prev_cell, dout, dhidden, dcell, dprev, dprev_cell, dgate, half_hidden;
+		BatchMat carried = BatchMat::Zero(_outDim, B), carried_cell = BatchMat::Zero(_outDim, B);
+		BatchMat ones = BatchMat::Ones(_outDim, B);
+		_input_gates_loss.setZero(_outDim, _steps * B);
+		_forget_gates_loss.setZero(_outDim, _steps * B);
+		_output_gates_loss.setZero(_outDim, _steps * B);
+		_half_cells_loss.setZero(_outDim, _steps * B);
+		for (int order = _steps - 1; order >= 0; order--) {
+			int step = stepAt(order);
+			if (order > 0) {
+				prev = _hiddens.middleCols(prevStep(step) * B, B);
+				prev_cell = _cells.middleCols(prevStep(step) * B, B);
+			}
+			else {
+				prev.setZero(_outDim, B);
+				prev_cell.setZero(_outDim, B);
+			}
+
+			dout = _hiddens_loss.middleCols(step * B, B) + carried;
+			dropStepBackward(dout, dhidden, step);
+
+			const BatchMat& in_gate = _input_gates.middleCols(step * B, B);
+			const BatchMat& forget_gate = _forget_gates.middleCols(step * B, B);
+			const BatchMat& out_gate = _output_gates.middleCols(step * B, B);
+			const BatchMat& half_cell = _half_cells.middleCols(step * B, B);
+			half_hidden = _cells.middleCols(step * B, B).array().tanh().matrix();
+
+			dcell = carried_cell + dhidden.cwiseProduct(out_gate).cwiseProduct(ones - half_hidden.cwiseProduct(half_hidden));
+			dprev.setZero(_outDim, B);
+			passMasked(dprev, dout, step);
+			dprev_cell = dcell.cwiseProduct(forget_gate);
+			passMasked(dprev_cell, carried_cell, step);
+
+			dgate = dhidden.cwiseProduct(half_hidden).cwiseProduct(out_gate.cwiseProduct(ones - out_gate));
+			zeroMasked(dgate, step);
+			_output_gates_loss.middleCols(step * B, B) = dgate;
+			batchRecurBackward(_param->output, prev, dgate, dprev);
+
+			dgate = dcell.cwiseProduct(half_cell).cwiseProduct(in_gate.cwiseProduct(ones - in_gate));
+			zeroMasked(dgate, step);
+			_input_gates_loss.middleCols(step * B, B) = dgate;
+			batchRecurBackward(_param->input, prev, dgate, dprev);
+
+			dgate = dcell.cwiseProduct(prev_cell).cwiseProduct(forget_gate.cwiseProduct(ones - forget_gate));
+			zeroMasked(dgate, step);
+			_forget_gates_loss.middleCols(step * B, B) = dgate;
+			batchRecurBackward(_param->forget, prev, dgate, dprev);
+
+			dgate = dcell.cwiseProduct(in_gate).cwiseProduct(ones - half_cell.cwiseProduct(half_cell));
+			zeroMasked(dgate, step);
+			_half_cells_loss.middleCols(step * B, B) = dgate;
+			batchRecurBackward(_param->cell, prev, dgate, dprev);
+
+			carried = dprev;
+			carried_cell = dprev_cell;
+		}
+		batchProjectBackward(_param->input, x, _input_gates_loss, x_loss);
+		batchProjectBackward(_param->forget, x, _forget_gates_loss, x_loss);
+		batchProjectBackward(_param->output, x, _output_gates_loss, x_loss);
+		batchProjectBackward(_param->cell, x, _half_cells_loss, x_loss);
+	}
+};
+
+#endif /*_BATCH_RECURRENT_H_*/
@@ -0,0 +1,126 @@
+#ifndef _BUCKET_SAMPLER_H_
+#define _BUCKET_SAMPLER_H_
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include "N3L.h"
+#include "Example.h"
+
+using namespace std;
+
+/*
+ draws the training minibatches of every epoch.
+ with bucketWidth > 0, examples are grouped by word count (and by char count when bChar),
+ each bucket is shuffled, the buckets are laid out from short to long and sliced into batches,
+ and the batch order is shuffled. a batch only spans two buckets when it takes the tail of one
+ and the head of the next, so the number of batches stays the same as without bucketing.
+ with bucketWidth <= 0 it is the plain shuffle-and-slice over all examples.
+ */
+class BucketSampler {
+public:
+	BucketSampler() {
+		_batchSize = 1;
+		_bucketWidth = 0;
+		_bChar = false;
+	}
+
+public:
+	void initial(const vector<Example>& examples, int batchSize, int bucketWidth, bool bChar) {
+		_batchSize = batchSize > 0 ? batchSize : 1;
+		_bucketWidth = bucketWidth;
+		_bChar = bChar;
+		_words.resize(examples.size());
+		_chars.resize(examples.size());
+		_indexes.resize(examples.size());
+		int total_words = 0, total_chars = 0;
+		for (int idx = 0; idx < examples.size(); idx++) {
+			_words[idx] = examples[idx].m_feature.wordNum();
+			_chars[idx] = examples[idx].m_feature.charNum();
+			_indexes[idx] = idx;
+			total_words += _words[idx];
+			total_chars += _chars[idx];
+		}
+
+		_buckets.clear();
+		if (_bucketWidth <= 0)
+			return;
+		// char buckets are as wide as bucketWidth average words
+		int chars_per_word = total_words > 0 ? (total_chars + total_words / 2) / total_words : 1;
+		int char_width = _bucketWidth * (chars_per_word > 0 ? chars_per_word : 1);
+		map<pair<int, int>, vector<int> > buckets;
+		for (int idx = 0; idx < examples.size(); idx++) {
+			pair<int, int> key(_words[idx] / _bucketWidth, _bChar ? _chars[idx] / char_width : 0);
+			buckets[key].push_back(idx);
+		}
+		map<pair<int, int>, vector<int> >::iterator it;
+		for (it = buckets.begin(); it != buckets.end(); it++) {
+			_buckets.push_back(it->second);
+		}
+	}
+
+	int batchNum() const {
+		return (_indexes.size() + _batchSize - 1) / _batchSize;
+	}
+
+	int bucketNum() const {
+		return _buckets.size();
+	}
+
+	void sample(vector<vector<int> >& batches) {
+		if (_bucketWidth > 0) {
+			_indexes.clear();
+			for (int idx = 0; idx < _buckets.size(); idx++) {
+				random_shuffle(_buckets[idx].begin(), _buckets[idx].end());
+				_indexes.insert(_indexes.end(), _buckets[idx].begin(), _buckets[idx].end());
+			}
+		}
+		else {
+			random_shuffle(_indexes.begin(), _indexes.end());
+		}
+
+		int inputSize = _indexes.size();
+		batches.resize(batchNum());
+		for (int updateIter = 0; updateIter < batches.size(); updateIter++) {
+			int start_pos = updateIter * _batchSize;
+			int end_pos = (updateIter + 1) * _batchSize;
+			if (end_pos > inputSize)
+				end_pos = inputSize;
+			batches[updateIter].assign(_indexes.begin() + start_pos, _indexes.begin() + end_pos);
+		}
+		if (_bucketWidth > 0)
+			random_shuffle(batches.begin(), batches.end());
+	}
+
+	// real tokens over the tokens of the batches padded to their longest example
+	dtype efficiency(const vector<vector<int> >& batches) const {
+		double real = 0, padded = 0;
+		for (int idx = 0; idx < batches.size(); idx++) {
+			int max_words = 0, max_chars = 0;
+			for (int idy = 0; idy < batches[idx].size(); idy++) {
+				int index = batches[idx][idy];
+				real += _words[index];
+				if (_words[index] > max_words)
+					max_words = _words[index];
+				if (_bChar) {
+					real += _chars[index];
+					if (_chars[index] > max_chars)
+						max_chars = _chars[index];
+				}
+			}
+			padded += (double)batches[idx].size() * (max_words + max_chars);
+		}
+		return padded > 0 ? real / padded : 1.0;
+	}
+
+private:
+	int _batchSize;
+	int _bucketWidth;
+	bool _bChar;
+	vector<int> _words;
+	vector<int> _chars;
+	vector<int> _indexes;
+	vector<vector<int> > _buckets;
+};
+
+#endif /*_BUCKET_SAMPLER_H_*/
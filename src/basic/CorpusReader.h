@@ -0,0 +1,204 @@
+#ifndef _CORPUS_READER_H_
+#define _CORPUS_READER_H_
+
+#include <cstring>
+#include "Instance.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// a piece of the mapped corpus
+struct TextSpan {
+	const char* data;
+	int size;
+};
+
+/*
+ reads the same instances as InstanceReader, "label \t word word ...", up to the first empty line.
+ the corpus is mapped (read into memory on windows) and cut at line boundaries into one range per thread.
+ each thread splits its lines into spans pointing into the mapping, which are turned into
+ instances only once, in place in the result vector, without intermediate strings.
+ open() and next() read the same instances one at a time through a line buffer instead,
+ for corpora that are decoded as they are read rather than held in memory.
+ */
+class CorpusReader {
+public:
+	CorpusReader(int nThreads = 1) {
+		_threads = nThreads < 1 ? 1 : nThreads;
+	}
+
+public:
+	bool readInstances(const string& file, vector<Instance>& vecInstances, int maxInstance = -1) {
+		vecInstances.clear();
+		MappedFile mapped;
+		if (!mapped.open(file)) {
+			cout << "CorpusReader::readInstances() open file err: " << file << endl;
+			return false;
+		}
+		if (mapped.size() == 0)
+			return true;
+		const char* data = mapped.data();
+		size_t size = mapped.size();
+
+		vector<size_t> bounds(_threads + 1);
+		bounds[0] = 0;
+		for (int idx = 1; idx < _threads; idx++) {
+			size_t pos = size * idx / _threads;
+			pos = pos > 0 ? nextLine(data, pos - 1, size) : 0;
+			bounds[idx] = pos > bounds[idx - 1] ? pos : bounds[idx - 1];
+		}
+		bounds[_threads] = size;
+
+		ThreadPool pool;
+		if (_threads > 1)
+			pool.start(_threads);
+		vector<Chunk> chunks(_threads);
+		pool.run(_threads, [&](int chunk) {
+			split(data, bounds[chunk], bounds[chunk + 1], chunks[chunk]);
+		});
+
+		// the instances before the first empty line, at most maxInstance of them
+		vector<int> firsts(_threads + 1, 0);
+		for (int chunk = 0; chunk < _threads; chunk++) {
+			int lines = chunks[chunk].lines();
+			if (chunks[chunk].empty_line >= 0)
+				lines = chunks[chunk].empty_line;
+			if (maxInstance > 0 && firsts[chunk] + lines > maxInstance)
+				lines = maxInstance - firsts[chunk];
+			firsts[chunk + 1] = firsts[chunk] + lines;
+			if (chunks[chunk].empty_line >= 0 || lines < chunks[chunk].lines()) {
+				for (int rest = chunk + 1; rest < _threads; rest++)
+					firsts[rest + 1] = firsts[chunk + 1];
+				break;
+			}
+		}
+
+		vecInstances.resize(firsts[_threads]);
+		pool.run(_threads, [&](int chunk) {
+			for (int line = 0; line < firsts[chunk + 1] - firsts[chunk]; line++)
+				chunks[chunk].assign(line, vecInstances[firsts[chunk] + line]);
+		});
+		return true;
+	}
+
+	bool open(const string& file) {
+		close();
+		_stream.open(file.c_str(), ios::binary);
+		if (!_stream.is_open()) {
+			cout << "CorpusReader::open() open file err: " << file << endl;
+			return false;
+		}
+		return true;
+	}
+
+	// false after the last instance, at the end of the file or at the first empty line
+	bool next(Instance& inst) {
+		if (!_stream.is_open() || !getline(_stream, _line))
+			return false;
+		size_t eol = _line.size();
+		while (eol > 0 && _line[eol - 1] == '\r')
+			eol--;
+		if (eol == 0)
+			return false;
+		_spans.clear();
+		splitLine(_line.data(), 0, eol, _spans);
+		assign(_spans.data(), _spans.size(), inst);
+		return true;
+	}
+
+	void close() {
+		if (_stream.is_open())
+			_stream.close();
+		_stream.clear();
+	}
+
+private:
+	// the spans of the lines of one range, the label of a line followed by its words
+	struct Chunk {
+		vector<TextSpan> spans;
+		vector<int> starts;
+		int empty_line;
+
+		Chunk() {
+			starts.push_back(0);
+			empty_line = -1;
+		}
+
+		int lines() const {
+			return starts.size() - 1;
+		}
+
+		void assign(int line, Instance& inst) const {
+			CorpusReader::assign(spans.data() + starts[line], starts[line + 1] - starts[line], inst);
+		}
+	};
+
+	// the label span followed by the word spans
+	static void assign(const TextSpan* spans, int count, Instance& inst) {
+		inst.allocate(count - 1);
+		inst.m_label.assign(spans[0].data, spans[0].size);
+		for (int idx = 1; idx < count; idx++)
+			inst.m_tweet[idx - 1].assign(spans[idx].data, spans[idx].size);
+	}
+
+	void split(const char* data, size_t start, size_t end, Chunk& chunk) {
+		for (size_t pos = start; pos < end; pos = nextLine(data, pos, end)) {
+			size_t eol = lineEnd(data, pos, end);
+			// my_getline drops the trailing '\r's
+			while (eol > pos && data[eol - 1] == '\r')
+				eol--;
+			if (eol == pos) {
+				chunk.empty_line = chunk.lines();
+				return;
+			}
+			splitLine(data, pos, eol, chunk.spans);
+			chunk.starts.push_back(chunk.spans.size());
+		}
+	}
+
+	// the first two nonempty tab fields of a line without its '\r's, the second split by spaces
+	static void splitLine(const char* data, size_t pos, size_t eol, vector<TextSpan>& spans) {
+		size_t label_begin = skip(data, pos, eol, '\t');
+		size_t label_end = find(data, label_begin, eol, '\t');
+		TextSpan label = { data + label_begin, int(label_end - label_begin) };
+		spans.push_back(label);
+		size_t text_begin = skip(data, label_end, eol, '\t');
+		size_t text_end = find(data, text_begin, eol, '\t');
+		for (size_t word_begin = skip(data, text_begin, text_end, ' '); word_begin < text_end; ) {
+			size_t word_end = find(data, word_begin, text_end, ' ');
+			TextSpan word = { data + word_begin, int(word_end - word_begin) };
+			spans.push_back(word);
+			word_begin = skip(data, word_end, text_end, ' ');
+		}
+	}
+
+	static size_t skip(const char* data, size_t pos, size_t end, char sep) {
+		while (pos < end && data[pos] == sep)
+			pos++;
+		return pos;
+	}
+
+	static size_t find(const char* data, size_t pos, size_t end, char sep) {
+		const char* p = (const char*)memchr(data + pos, sep, end - pos);
+		return p == NULL ? end : p - data;
+	}
+
+	static size_t lineEnd(const char* data, size_t pos, size_t end) {
+		return find(data, pos, end, '\n');
+	}
+
+	static size_t nextLine(const char* data, size_t pos, size_t end) {
+		size_t eol = lineEnd(data, pos, end);
+		return eol < end ? eol + 1 : end;
+	}
+
+private:
+	int _threads;
+	// of open() and next()
+	ifstream _stream;
+	string _line;
+	vector<TextSpan> _spans;
+};
+
+#endif /*_CORPUS_READER_H_*/
@@ -0,0 +1,244 @@
+#ifndef _EMBEDDING_LOADER_H_
+#define _EMBEDDING_LOADER_H_
+
+#include <cstring>
+#include <sys/stat.h>
+#include "ModelFile.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+/*
+ LookupTable::initial(elems, file, bFineTune) for large pretrained embedding files.
+ the text file is mapped and parsed by several threads, each on its own range of lines,
+ and only the rows of elements in the alphabet are kept.
+ those rows are cached in a binary file beside the embedding file, named by a hash of the
+ file's path, size and modification time and of the alphabet, so that a later run with
+ the same file and alphabet maps the cache instead of parsing the text again.
+ rows missing from the file keep the random values of LookupTable, and the unknown row
+ becomes the average of the loaded rows if the file has none.
+ */
+class EmbeddingLoader {
+public:
+	EmbeddingLoader(int nThreads = 1) {
+		_threads = nThreads < 1 ? 1 : nThreads;
+	}
+
+public:
+	void load(LookupTable& table, PAlphabet elems, const string& file, bool bFineTune) {
+		string cache;
+		if (!cacheFile(file, elems, cache)) {
+			std::cout << "embedding file " << file << " can not be opened" << std::endl;
+			table.initial(elems, file, bFineTune);
+			return;
+		}
+
+		int dim = 0;
+		vector<int> ids;
+		ModelReader reader;
+		if (reader.open(cache, "embeddings")) {
+			reader.read(dim);
+			reader.read(ids);
+			const dtype* values = reader.readValues(dim * ids.size());
+			if (reader.good() && validIds(ids, elems)) {
+				assign(table, elems, dim, ids, values, bFineTune);
+				std::cout << ids.size() << " of " << elems->size() << " embeddings loaded from " << cache << std::endl;
+				return;
+			}
+		}
+
+		vector<dtype> values;
+		if (!parse(file, elems, dim, ids, values)) {
+			std::cout << "embedding file " << file << " can not be parsed" << std::endl;
+			table.initial(elems, file, bFineTune);
+			return;
+		}
+		assign(table, elems, dim, ids, values.data(), bFineTune);
+		std::cout << ids.size() << " of " << elems->size() << " embeddings loaded from " << file << std::endl;
+
+		ModelWriter writer;
+		if (writer.open(cache, "embeddings")) {
+			writer.write(dim);
+			writer.write(ids);
+			writer.writeValues(values.data(), values.size());
+		}
+		if (!writer.good())
+			std::cout << "embedding cache " << cache << " can not be written" << std::endl;
+	}
+
+private:
+	bool cacheFile(const string& file, PAlphabet elems, string& cache) {
+		struct stat st;
+		if (stat(file.c_str(), &st) < 0)
+			return false;
+		// 64-bit FNV-1a
+		unsigned long long hash = 14695981039346656037ULL;
+		ostringstream key;
+		key << file << '\n' << st.st_size << '\n' << st.st_mtime << '\n';
+		for (int idx = 0; idx < elems->size(); idx++)
+			key << elems->from_id(idx) << '\n';
+		const string& bytes = key.str();
+		for (int idx = 0; idx < bytes.size(); idx++) {
+			hash ^= (unsigned char)bytes[idx];
+			hash *= 1099511628211ULL;
+		}
+		ostringstream name;
+		name << file << "." << std::hex << hash << ".cache";
+		cache = name.str();
+		return true;
+	}
+
+	bool validIds(const vector<int>& ids, PAlphabet elems) {
+		for (int idx = 0; idx < ids.size(); idx++) {
+			if (ids[idx] < 0 || ids[idx] >= elems->size())
+				return false;
+		}
+		return true;
+	}
+
+	void assign(LookupTable& table, PAlphabet elems, int dim, const vector<int>& ids, const dtype* values, bool bFineTune) {
+		table.initial(elems, dim, bFineTune);
+		int unknownId = elems->from_string(unknownkey);
+		bool bHasUnknown = false;
+		vector<dtype> sum(dim, 0);
+		for (int idx = 0; idx < ids.size(); idx++) {
+			for (int idy = 0; idy < dim; idy++) {
+				table.E.val[ids[idx]][idy] = values[idx * dim + idy];
+				sum[idy] += values[idx * dim + idy];
+			}
+			if (ids[idx] == unknownId)
+				bHasUnknown = true;
+		}
+		if (!bHasUnknown && unknownId >= 0 && ids.size() > 0) {
+			for (int idy = 0; idy < dim; idy++)
+				table.E.val[unknownId][idy] = sum[idy] / ids.size();
+		}
+	}
+
+	// rows of the alphabet in the order of their first line, a later line of the same element wins
+	bool parse(const string& file, PAlphabet elems, int& dim, vector<int>& ids, vector<dtype>& values) {
+		MappedFile mapped;
+		if (!mapped.open(file) || mapped.size() == 0)
+			return false;
+		const char* data = mapped.data();
+		size_t size = mapped.size();
+
+		// the dimension comes from the first row, the "count dim" line of word2vec files is skipped
+		size_t start = 0;
+		int fields = countFields(data, start, size);
+		if (fields == 2) {
+			start = nextLine(data, 0, size);
+			fields = countFields(data, start, size);
+		}
+		dim = fields - 1;
+		if (dim <= 0)
+			return false;
+
+		unordered_map<string, int> elem_ids;
+		for (int idx = 0; idx < elems->size(); idx++)
+			elem_ids[elems->from_id(idx)] = idx;
+
+		vector<size_t> bounds(_threads + 1);
+		bounds[0] = start;
+		for (int idx = 1; idx < _threads; idx++) {
+			size_t pos = start + (size - start) * idx / _threads;
+			pos = pos > 0 ? nextLine(data, pos - 1, size) : 0;
+			bounds[idx] = pos > bounds[idx - 1] ? pos : bounds[idx - 1];
+		}
+		bounds[_threads] = size;
+
+		vector<vector<int> > chunk_ids(_threads);
+		vector<vector<dtype> > chunk_values(_threads);
+		ThreadPool pool;
+		if (_threads > 1)
+			pool.start(_threads);
+		pool.run(_threads, [&](int chunk) {
+			parseLines(data, bounds[chunk], bounds[chunk + 1], elem_ids, dim, chunk_ids[chunk], chunk_values[chunk]);
+		});
+		mapped.close();
+
+		ids.clear();
+		values.clear();
+		vector<int> positions(elems->size(), -1);
+		for (int chunk = 0; chunk < _threads; chunk++) {
+			for (int idx = 0; idx < chunk_ids[chunk].size(); idx++) {
+				int id = chunk_ids[chunk][idx];
+				const dtype* row = chunk_values[chunk].data() + idx * dim;
+				if (positions[id] < 0) {
+					positions[id] = ids.size();
+					ids.push_back(id);
+					values.insert(values.end(), row, row + dim);
+				}
+				else {
+					std::copy(row, row + dim, values.begin() + positions[id] * dim);
+				}
+			}
+		}
+		return true;
+	}
+
+	void parseLines(const char* data, size_t start, size_t end, const unordered_map<string, int>& elem_ids, int dim,
+		vector<int>& ids, vector<dtype>& values) {
+		string line;
+		vector<dtype> row(dim);
+		for (size_t pos = start; pos < end; pos = nextLine(data, pos, end)) {
+			line.assign(data + pos, lineEnd(data, pos, end) - pos);
+			const char* p = line.c_str();
+			const char* word_end = p;
+			while (*word_end != 0 && *word_end != ' ' && *word_end != '\t')
+				word_end++;
+			unordered_map<string, int>::const_iterator it = elem_ids.find(string(p, word_end));
+			if (it == elem_ids.end())
+				continue;
+			p = word_end;
+			int count = 0;
+			while (count <= dim) {
+				while (*p == ' ' || *p == '\t' || *p == '\r')
+					p++;
+				if (*p == 0)
+					break;
+				char* value_end;
+				dtype value = strtod(p, &value_end);
+				if (value_end == p)
+					break;
+				if (count < dim)
+					row[count] = value;
+				count++;
+				p = value_end;
+			}
+			if (count != dim)
+				continue;
+			ids.push_back(it->second);
+			values.insert(values.end(), row.begin(), row.end());
+		}
+	}
+
+	static int countFields(const char* data, size_t pos, size_t end) {
+		size_t eol = lineEnd(data, pos, end);
+		int fields = 0;
+		bool inField = false;
+		for (; pos < eol; pos++) {
+			bool blank = data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\r';
+			if (!blank && !inField)
+				fields++;
+			inField = !blank;
+		}
+		return fields;
+	}
+
+	static size_t lineEnd(const char* data, size_t pos, size_t end) {
+		const char* p = (const char*)memchr(data + pos, '\n', end - pos);
+		return p == NULL ? end : p - data;
+	}
+
+	static size_t nextLine(const char* data, size_t pos, size_t end) {
+		size_t eol = lineEnd(data, pos, end);
+		return eol < end ? eol + 1 : end;
+	}
+
+private:
+	int _threads;
+};
+
+#endif /*_EMBEDDING_LOADER_H_*/
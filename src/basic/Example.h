@@ -12,12 +12,44 @@ public:
 	vector<string> m_chars;
 	vector<string> m_tweet_words;
 	vector<string> m_linear_features;
+
+	// alphabet ids of m_tweet_words followed by those of m_chars, see Classifier::initialIds.
+	// m_char_offset stays -1 until they are resolved, the strings are released afterwards.
+	vector<int> m_ids;
+	int m_char_offset;
 public:
+	Feature()
+	{
+		m_char_offset = -1;
+	}
+
 	void clear()
 	{
 		m_chars.clear();
 		m_tweet_words.clear();
 		m_linear_features.clear();
+		m_ids.clear();
+		m_char_offset = -1;
+	}
+
+	inline int wordNum() const
+	{
+		return m_char_offset < 0 ? m_tweet_words.size() : m_char_offset;
+	}
+
+	inline int charNum() const
+	{
+		return m_char_offset < 0 ? m_chars.size() : m_ids.size() - m_char_offset;
+	}
+
+	inline const int* wordIds() const
+	{
+		return m_ids.data();
+	}
+
+	inline const int* charIds() const
+	{
+		return m_ids.data() + m_char_offset;
 	}
 };
 
@@ -25,13 +57,18 @@ class Example
 {
 public:
 	Feature m_feature;
-	vector<double> m_label;
+	int m_label; // id in labelAlpha
 
 public:
+	Example()
+	{
+		m_label = -1;
+	}
+
 	void clear()
 	{
 		m_feature.clear();
-		m_label.clear();
+		m_label = -1;
 	}
 };
 
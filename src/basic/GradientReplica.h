@@ -0,0 +1,106 @@
+#ifndef _GRADIENT_REPLICA_H_
+#define _GRADIENT_REPLICA_H_
+
+#include "N3L.h"
+#include "SparseRows.h"
+
+using namespace std;
+
+/*
+ the parameters of one data-parallel training worker.
+ after bind(), every replica parameter reads the weights of its master in place,
+ so only the gradients are private to the worker.
+ both parameter lists must come from exportModelParams, i.e., in the same order.
+ the embedding tables of a replica have no buffers at all (see replicaTable in SparseRows.h),
+ bindTable() binds their values and keeps their gradients in a SparseRows.
+ */
+class GradientReplica {
+public:
+	GradientReplica() {
+	}
+
+	~GradientReplica() {
+		release();
+	}
+
+public:
+	void bind(const ModelUpdate& master, const ModelUpdate& replica) {
+		release();
+		assert(master._params.size() == replica._params.size());
+		_masters = master._params;
+		_replicas = replica._params;
+		for (int idx = 0; idx < _replicas.size(); idx++) {
+			_own_values.push_back(_replicas[idx]->val.v);
+			_replicas[idx]->val.v = _masters[idx]->val.v;
+		}
+		_rows.assign(_replicas.size(), NULL);
+	}
+
+	// after bind(): untuned tables are not exported and are bound here, the others were bound by bind()
+	void bindTable(LookupTable& replica, const LookupTable& master, SparseRows& rows) {
+		rows.initial(replica.nDim, replica.nVSize);
+		for (int idx = 0; idx < _replicas.size(); idx++) {
+			if (_replicas[idx] == &replica.E) {
+				_rows[idx] = &rows;
+				return;
+			}
+		}
+		_tables.push_back(&replica.E);
+		_table_values.push_back(replica.E.val.v);
+		replica.E.val.v = master.E.val.v;
+	}
+
+	// gives the replica its own value buffers back before it is destroyed
+	void release() {
+		for (int idx = 0; idx < _own_values.size(); idx++) {
+			_replicas[idx]->val.v = _own_values[idx];
+		}
+		for (int idx = 0; idx < _tables.size(); idx++) {
+			_tables[idx]->val.v = _table_values[idx];
+		}
+		_own_values.clear();
+		_tables.clear();
+		_table_values.clear();
+		_rows.clear();
+		_masters.clear();
+		_replicas.clear();
+	}
+
+	int size() const {
+		return _replicas.size();
+	}
+
+	// adds the gradient of the idx-th parameter into the master and clears it
+	void accumulate(int idx) {
+		if (idx >= _replicas.size())
+			return;
+		BaseParam* master = _masters[idx];
+		BaseParam* replica = _replicas[idx];
+		SparseRows* rows = _rows[idx];
+		SparseParam* sparse_master = dynamic_cast<SparseParam*>(master);
+		if (rows != NULL && sparse_master != NULL) {
+			int outDim = sparse_master->grad.row;
+			for (int slot = 0; slot < rows->size(); slot++) {
+				int index = rows->row(slot);
+				const dtype* grad = rows->grad(slot);
+				sparse_master->indexers[index] = true;
+				for (int idy = 0; idy < outDim; idy++)
+					sparse_master->grad[index][idy] += grad[idy];
+			}
+			rows->clear();
+			return;
+		}
+		master->grad.mat() += replica->grad.mat();
+		replica->clearGrad();
+	}
+
+private:
+	vector<BaseParam*> _masters;
+	vector<BaseParam*> _replicas;
+	vector<dtype*> _own_values;
+	vector<SparseRows*> _rows; // of every parameter, NULL for dense ones
+	vector<SparseParam*> _tables; // untuned tables bound by bindTable
+	vector<dtype*> _table_values;
+};
+
+#endif /*_GRADIENT_REPLICA_H_*/
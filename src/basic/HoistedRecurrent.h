@@ -0,0 +1,210 @@
+#ifndef _HOISTED_RECURRENT_H_
+#define _HOISTED_RECURRENT_H_
+
+#include "SequenceNodes.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+/*
+ drop-in replacements of RNNBuilder, GRNNBuilder and LSTMBuilder for the per-sentence graphs.
+ with hoist, the whole sequence is one node running a BatchRecurrent layer over a batch of one,
+ so the input projections of all steps are a single GEMM and only W1 * h stays sequential.
+ without hoist, the library builder does the work as before on the steps of the input.
+ either way the outputs are the sequence output(), the node the layers above consume.
+ */
+
+// the whole recurrence over one sentence, its value is the hidden matrix of the layer
+template<class BatchLayer>
+class RecurrentSeqNode : public SeqNode {
+public:
+	BatchLayer _layer;
+	SeqNode* _in;
+	vector<int> _lengths;
+	BatchMat _x_loss;
+
+public:
+	RecurrentSeqNode() : SeqNode() {
+		_in = NULL;
+	}
+
+	inline BatchMat& seqVal() {
+		return _layer._hiddens;
+	}
+
+	inline BatchMat& seqLoss() {
+		return _layer._hiddens_loss;
+	}
+
+	inline void forward(Graph* cg, SeqNode* x) {
+		_in = x;
+		_bTrain = cg->train;
+		cg->addNode(this);
+	}
+
+	inline void compute() {
+		int steps = _in->steps();
+		_lengths.assign(1, steps);
+		_layer.forward(_in->seqVal(), _lengths, steps, _bTrain);
+	}
+
+	inline void backward() {
+		layerBackward();
+		scatterLoss();
+	}
+
+	// gradients and input losses of the layer, the input itself is not touched
+	inline void layerBackward() {
+		_x_loss.setZero(_layer._inDim, _in->steps());
+		_layer.backward(_in->seqVal(), _x_loss);
+	}
+
+	inline void scatterLoss() {
+		_in->seqLoss() += _x_loss;
+	}
+};
+
+template<class Params, class BatchLayer, class Builder>
+class HoistedBuilder {
+public:
+	Builder _builder;
+	vector<SeqStepNode> _inputs; // the steps the library builder reads, without hoist
+	WindowSeqNode _outputs; // the outputs of the library builder as a sequence, without hoist
+	RecurrentSeqNode<BatchLayer> _seq;
+	bool _hoist;
+
+public:
+	HoistedBuilder() {
+		_hoist = true;
+	}
+
+	virtual ~HoistedBuilder() {
+	}
+
+	inline void resize(int maxsize) {
+		_builder.resize(maxsize);
+		_inputs.resize(maxsize);
+	}
+
+	inline void clear() {
+		_builder.clear();
+		_inputs.clear();
+	}
+
+	// with inference the steps read by the library builder get no losses
+	inline void init(Params* paramInit, dtype dropout, bool left2right = true, AlignedMemoryPool* mem = NULL, bool hoist = true, bool inference = false) {
+		_hoist = hoist;
+		_seq._layer.init(paramInit, dropout, left2right);
+		if (_hoist)
+			return;
+		_builder.init(paramInit, dropout, left2right, mem);
+		for (int idx = 0; idx < _inputs.size(); idx++) {
+			if (inference)
+				initValue(_inputs[idx], _seq._layer._inDim, -1, mem);
+			else
+				_inputs[idx].init(_seq._layer._inDim, -1, mem);
+		}
+		_outputs.init(_seq._layer._outDim, 0);
+	}
+
+	inline void forward(Graph* cg, SeqNode* x) {
+		if (_hoist) {
+			_seq.forward(cg, x);
+			return;
+		}
+		int steps = x->steps();
+		forwardSteps(cg, x, _inputs, steps);
+		vector<PNode> outputs;
+		if (steps > 0) {
+			_builder.forward(cg, getPNodes(_inputs, steps));
+			for (int idx = 0; idx < steps; idx++)
+				outputs.push_back(builderOutput(idx));
+		}
+		_outputs.forward(cg, outputs);
+	}
+
+	inline SeqNode* output() {
+		if (_hoist)
+			return &_seq;
+		return &_outputs;
+	}
+
+protected:
+	virtual PNode builderOutput(int idx) = 0;
+};
+
+class HoistedRNNBuilder : public HoistedBuilder<RNNParams, BatchRNN, RNNBuilder> {
+protected:
+	PNode builderOutput(int idx) {
+		return &_builder._output[idx];
+	}
+};
+
+class HoistedGRNNBuilder : public HoistedBuilder<GRNNParams, BatchGRNN, GRNNBuilder> {
+protected:
+	PNode builderOutput(int idx) {
+		return &_builder._output[idx];
+	}
+};
+
+class HoistedLSTMBuilder : public HoistedBuilder<LSTMParams, BatchLSTM, LSTMBuilder> {
+protected:
+	PNode builderOutput(int idx) {
+		return &_builder._hiddens[idx];
+	}
+};
+
+/*
+ the left-to-right and right-to-left builders of a bidirectional layer over the same inputs.
+ with hoisting, both recurrences are one node whose forward and backward run the two
+ directions on two threads and meet again before their outputs reach the concat.
+ the input losses of both directions are added afterwards on the calling thread.
+ */
+template<class HBuilder>
+class BiRecurrentNode : public Node {
+public:
+	HBuilder* _left;
+	HBuilder* _right;
+	ThreadPool* _pool;
+
+public:
+	BiRecurrentNode() : Node() {
+		_left = _right = NULL;
+		_pool = NULL;
+	}
+
+	inline void setParam(HBuilder* left, HBuilder* right, ThreadPool* pool) {
+		_left = left;
+		_right = right;
+		_pool = pool;
+	}
+
+	inline void forward(Graph* cg, SeqNode* x) {
+		if (!_left->_hoist || !_right->_hoist) {
+			_left->forward(cg, x);
+			_right->forward(cg, x);
+			return;
+		}
+		_left->_seq._in = x;
+		_left->_seq._bTrain = cg->train;
+		_right->_seq._in = x;
+		_right->_seq._bTrain = cg->train;
+		cg->addNode(this);
+	}
+
+	inline void compute() {
+		future<void> left = _pool->push([this]() { _left->_seq.compute(); });
+		_right->_seq.compute();
+		left.get();
+	}
+
+	inline void backward() {
+		future<void> left = _pool->push([this]() { _left->_seq.layerBackward(); });
+		_right->_seq.layerBackward();
+		left.get();
+		_left->_seq.scatterLoss();
+		_right->_seq.scatterLoss();
+	}
+};
+
+#endif /*_HOISTED_RECURRENT_H_*/
@@ -0,0 +1,62 @@
+#ifndef _ID_LOOKUP_NODE_H_
+#define _ID_LOOKUP_NODE_H_
+
+#include "N3L.h"
+#include "SparseRows.h"
+
+using namespace std;
+
+// a LookupNode fed with an alphabet id resolved ahead of time instead of the string itself
+class IdLookupNode : public LookupNode {
+public:
+	SparseRows* _rows; // gradients of a replica table, see SparseRows.h
+
+public:
+	using LookupNode::init;
+	using LookupNode::forward;
+	using LookupNode::setParam;
+
+	IdLookupNode() : LookupNode() {
+		_rows = NULL;
+	}
+
+	inline void setParam(LookupTable* paramInit, SparseRows* rows) {
+		LookupNode::setParam(paramInit);
+		_rows = rows;
+	}
+
+	// a graph that only decodes never runs backward, so the loss and drop mask are left out
+	inline void init(int ndim, dtype dropout, AlignedMemoryPool* mem, bool inference) {
+		if (!inference) {
+			LookupNode::init(ndim, dropout, mem);
+			return;
+		}
+		dim = ndim;
+		val.init(dim, mem);
+		drop_value = dropout > 0 && dropout <= 1 ? dropout : -1;
+	}
+
+	inline void forward(Graph* cg, int id) {
+		assert(param != NULL);
+		xid = id;
+		if (xid < 0 && param->nUNKId >= 0) {
+			xid = param->nUNKId;
+		}
+		if (param->bFineTune && xid < 0) {
+			std::cout << "Caution: unknown words are not modeled !" << std::endl;
+		}
+		cg->addNode(this);
+	}
+
+	// a replica table has no E.grad, its losses go to the rows; untuned tables are never updated
+	inline void backward() {
+		if (_rows == NULL || !_rows->active()) {
+			LookupNode::backward();
+			return;
+		}
+		if (param->bFineTune && xid >= 0)
+			_rows->add(xid, loss.v);
+	}
+};
+
+#endif /*_ID_LOOKUP_NODE_H_*/
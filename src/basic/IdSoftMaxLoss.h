@@ -0,0 +1,78 @@
+#ifndef _ID_SOFTMAX_LOSS_H_
+#define _ID_SOFTMAX_LOSS_H_
+
+#include "N3L.h"
+
+using namespace std;
+
+// a SoftMaxLoss fed with the label id of the answer instead of a one-hot vector,
+// a negative id (a label outside labelAlpha) has no gold label as the all-zero vector
+class IdSoftMaxLoss : public SoftMaxLoss {
+public:
+	using SoftMaxLoss::loss;
+	using SoftMaxLoss::cost;
+	using SoftMaxLoss::predict;
+
+	inline dtype loss(PNode x, int answer, Metric& eval, int batchsize = 1) {
+		int nDim = x->dim;
+		int optLabel = 0;
+		for (int i = 1; i < nDim; ++i) {
+			if (x->val[i] > x->val[optLabel])
+				optLabel = i;
+		}
+
+		// the scores are kept in x->loss until the gradient replaces them
+		dtype sum1 = 0, sum2 = 0, maxScore = x->val[optLabel];
+		for (int i = 0; i < nDim; ++i) {
+			x->loss[i] = exp(x->val[i] - maxScore);
+			sum2 += x->loss[i];
+		}
+		if (answer >= 0 && answer < nDim)
+			sum1 = x->loss[answer];
+		if (optLabel == answer)
+			eval.correct_label_count++;
+		eval.overall_label_count++;
+
+		for (int i = 0; i < nDim; ++i)
+			x->loss[i] = (x->loss[i] / sum2 - (i == answer ? 1 : 0)) / batchsize;
+		return (log(sum2) - log(sum1)) / batchsize;
+	}
+
+	inline dtype cost(PNode x, int answer, int batchsize = 1) {
+		int nDim = x->dim;
+		dtype maxScore = x->val[0];
+		for (int i = 1; i < nDim; ++i) {
+			if (x->val[i] > maxScore)
+				maxScore = x->val[i];
+		}
+
+		dtype sum1 = 0, sum2 = 0;
+		for (int i = 0; i < nDim; ++i) {
+			dtype score = exp(x->val[i] - maxScore);
+			if (i == answer)
+				sum1 = score;
+			sum2 += score;
+		}
+		return (log(sum2) - log(sum1)) / batchsize;
+	}
+
+	// predict() along with the probabilities of all labels
+	inline void predict(PNode x, int& y, dtype* probs) {
+		int nDim = x->dim;
+		y = 0;
+		for (int i = 1; i < nDim; ++i) {
+			if (x->val[i] > x->val[y])
+				y = i;
+		}
+
+		dtype sum = 0;
+		for (int i = 0; i < nDim; ++i) {
+			probs[i] = exp(x->val[i] - x->val[y]);
+			sum += probs[i];
+		}
+		for (int i = 0; i < nDim; ++i)
+			probs[i] /= sum;
+	}
+};
+
+#endif /*_ID_SOFTMAX_LOSS_H_*/
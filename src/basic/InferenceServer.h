@@ -0,0 +1,306 @@
+#ifndef _INFERENCE_SERVER_H_
+#define _INFERENCE_SERVER_H_
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <deque>
+#include <memory>
+#include "ThreadPool.h"
+
+using namespace std;
+
+/*
+ the -serve mode of the labelers: one request per line, one response line per request.
+ requests come from the clients of a unix domain socket, or from stdin with the responses
+ on stdout if no socket is given. every client is read by a thread of its own and its
+ requests are queued; the serving thread takes up to maxBatch queued requests at once,
+ waiting at most maxWait microseconds after the first one for others to arrive, and
+ hands them to the handler as one batch. each client gets its responses in the order
+ of its requests from a writer thread of its own, so a client that stops reading only
+ stalls itself: once it has max_pending requests unanswered or unwritten, its reader
+ stops taking requests until the writer catches up.
+ unix domain sockets are not available on windows, where only stdin is served.
+ */
+class InferenceServer {
+public:
+	// fills one response per request
+	typedef function<void(const vector<string>&, vector<string>&)> Handler;
+
+	const static int max_pending = 1024;
+
+	InferenceServer(int maxBatch = 32, int maxWait = 1000) {
+		_max_batch = maxBatch < 1 ? 1 : maxBatch;
+		_max_wait = maxWait < 0 ? 0 : maxWait;
+		_closed = false;
+	}
+
+public:
+	// serves until stdin ends, or for good on a socket
+	bool serve(const string& socketFile, const Handler& handler) {
+		if (socketFile == "") {
+			shared_ptr<Client> client(new Client(0, 1, false));
+			thread reader([this, client]() { serveClient(client); close(); });
+			batchLoop(handler);
+			reader.join();
+			return true;
+		}
+
+#if defined(_WIN32)
+		std::cerr << "unix domain sockets are not supported here, serve on stdin instead" << std::endl;
+		return false;
+#else
+		int fd = listenOn(socketFile);
+		if (fd < 0)
+			return false;
+		std::cerr << "serving on " << socketFile << std::endl;
+		thread acceptor([this, fd]() {
+			while (true) {
+				int client_fd = accept(fd, NULL, NULL);
+				if (client_fd < 0) {
+					if (errno == EINTR)
+						continue;
+					break;
+				}
+				shared_ptr<Client> client(new Client(client_fd, client_fd, true));
+				thread([this, client]() { serveClient(client); }).detach();
+			}
+			close();
+		});
+		batchLoop(handler);
+		acceptor.join();
+		::close(fd);
+		unlink(socketFile.c_str());
+		return true;
+#endif
+	}
+
+private:
+	struct Client {
+		int in_fd, out_fd;
+		bool own; // a socket, closed with the client
+		mutex lock;
+		condition_variable cond;
+		deque<string> responses; // answered, not yet written
+		int pending; // requests queued and not yet written
+		bool reading; // more requests may come
+		bool broken; // the output failed, responses are dropped
+
+		Client(int in, int out, bool owned) : in_fd(in), out_fd(out), own(owned) {
+			pending = 0;
+			reading = true;
+			broken = false;
+		}
+
+		// the last pending response has been written by then
+		~Client() {
+#if !defined(_WIN32)
+			if (own)
+				::close(in_fd);
+#endif
+		}
+
+		long readSome(char* buffer, size_t size) {
+#if defined(_WIN32)
+			return _read(in_fd, buffer, (unsigned)size);
+#else
+			return ::read(in_fd, buffer, size);
+#endif
+		}
+
+		bool writeAll(const string& line) {
+			size_t written = 0;
+			while (written < line.size()) {
+#if defined(_WIN32)
+				long count = _write(out_fd, line.data() + written, (unsigned)(line.size() - written));
+#else
+				long count = own ? send(out_fd, line.data() + written, line.size() - written, MSG_NOSIGNAL)
+					: ::write(out_fd, line.data() + written, line.size() - written);
+#endif
+				if (count < 0 && errno == EINTR)
+					continue;
+				if (count <= 0)
+					return false;
+				written += count;
+			}
+			return true;
+		}
+
+		// called for requests before they are queued, waits while too many are pending
+		void request(int count) {
+			unique_lock<mutex> guard(lock);
+			cond.wait(guard, [this]() { return pending < max_pending; });
+			pending += count;
+		}
+
+		// never blocks, the writer thread does the writing
+		void respond(const string& response) {
+			unique_lock<mutex> guard(lock);
+			responses.push_back(response);
+			cond.notify_all();
+		}
+
+		void endRequests() {
+			unique_lock<mutex> guard(lock);
+			reading = false;
+			cond.notify_all();
+		}
+
+		// until every request has been answered and written
+		void writeLoop() {
+			while (true) {
+				string line;
+				{
+					unique_lock<mutex> guard(lock);
+					cond.wait(guard, [this]() { return !responses.empty() || (!reading && pending == 0); });
+					if (responses.empty())
+						return;
+					line.swap(responses.front());
+					responses.pop_front();
+				}
+				if (!broken)
+					broken = !writeAll(line + "\n");
+				unique_lock<mutex> guard(lock);
+				pending--;
+				cond.notify_all();
+			}
+		}
+	};
+
+	struct Request {
+		shared_ptr<Client> client;
+		string line;
+	};
+
+#if !defined(_WIN32)
+	int listenOn(const string& socketFile) {
+		struct sockaddr_un addr;
+		if (socketFile.size() >= sizeof(addr.sun_path)) {
+			std::cerr << "socket path too long: " << socketFile << std::endl;
+			return -1;
+		}
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, socketFile.c_str(), sizeof(addr.sun_path) - 1);
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0) {
+			std::cerr << "socket error: " << strerror(errno) << std::endl;
+			return -1;
+		}
+		unlink(socketFile.c_str());
+		if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+			std::cerr << "can not listen on " << socketFile << ": " << strerror(errno) << std::endl;
+			::close(fd);
+			return -1;
+		}
+		return fd;
+	}
+#endif
+
+	// reads a client on this thread and writes its responses on another
+	void serveClient(const shared_ptr<Client>& client) {
+		thread writer([client]() { client->writeLoop(); });
+		read(client);
+		client->endRequests();
+		writer.join();
+	}
+
+	// queues the lines of a client until it closes, trailing '\r's dropped as by my_getline
+	void read(const shared_ptr<Client>& client) {
+		char buffer[65536];
+		string line;
+		while (true) {
+			long count = client->readSome(buffer, sizeof(buffer));
+			if (count < 0 && errno == EINTR)
+				continue;
+			if (count <= 0)
+				break;
+			vector<Request> requests;
+			for (char* p = buffer; p < buffer + count; ) {
+				char* eol = (char*)memchr(p, '\n', buffer + count - p);
+				if (eol == NULL) {
+					line.append(p, buffer + count - p);
+					break;
+				}
+				line.append(p, eol - p);
+				while (!line.empty() && line[line.size() - 1] == '\r')
+					line.resize(line.size() - 1);
+				Request request = { client, line };
+				requests.push_back(request);
+				line.clear();
+				p = eol + 1;
+			}
+			push(requests);
+		}
+		if (!line.empty()) {
+			Request request = { client, line };
+			push(vector<Request>(1, request));
+		}
+	}
+
+	void push(const vector<Request>& requests) {
+		if (requests.empty())
+			return;
+		requests[0].client->request(requests.size());
+		unique_lock<mutex> lock(_mutex);
+		if (_queue.empty())
+			_first_arrival = chrono::steady_clock::now();
+		_queue.insert(_queue.end(), requests.begin(), requests.end());
+		_cond.notify_one();
+	}
+
+	void close() {
+		unique_lock<mutex> lock(_mutex);
+		_closed = true;
+		_cond.notify_one();
+	}
+
+	void batchLoop(const Handler& handler) {
+		vector<Request> batch;
+		vector<string> lines, responses;
+		while (true) {
+			{
+				unique_lock<mutex> lock(_mutex);
+				_cond.wait(lock, [this]() { return _closed || !_queue.empty(); });
+				if (_queue.empty())
+					return;
+				chrono::steady_clock::time_point deadline = _first_arrival + chrono::microseconds(_max_wait);
+				_cond.wait_until(lock, deadline, [this]() { return _closed || _queue.size() >= _max_batch; });
+				int count = _queue.size() < _max_batch ? _queue.size() : _max_batch;
+				batch.assign(_queue.begin(), _queue.begin() + count);
+				_queue.erase(_queue.begin(), _queue.begin() + count);
+				// the requests left behind have waited since before now
+				_first_arrival = chrono::steady_clock::now() - chrono::microseconds(_max_wait);
+			}
+
+			lines.resize(batch.size());
+			for (int idx = 0; idx < batch.size(); idx++)
+				lines[idx] = batch[idx].line;
+			responses.clear();
+			handler(lines, responses);
+			responses.resize(batch.size());
+			for (int idx = 0; idx < batch.size(); idx++)
+				batch[idx].client->respond(responses[idx]);
+			batch.clear();
+		}
+	}
+
+private:
+	int _max_batch;
+	int _max_wait;
+	mutex _mutex;
+	condition_variable _cond;
+	deque<Request> _queue;
+	chrono::steady_clock::time_point _first_arrival;
+	bool _closed;
+};
+
+#endif /*_INFERENCE_SERVER_H_*/
@@ -0,0 +1,174 @@
+#ifndef _LAZY_SPARSE_UPDATE_H_
+#define _LAZY_SPARSE_UPDATE_H_
+
+#include "N3L.h"
+
+using namespace std;
+
+/*
+ ModelUpdate::update(maxScale) with sparse embedding tables.
+ the rows a minibatch touches are recorded through touch() from the example ids,
+ and the norm, rescaling, adagrad step and clearing of a table only visit those rows.
+ the l2 regularization a row missed while it was not touched is applied lazily
+ the next time it is updated, from the step of its last update.
+ all other parameters go through BaseParam as in ModelUpdate.
+ */
+class LazySparseUpdate {
+public:
+	LazySparseUpdate() {
+		_ada = NULL;
+		_step = 0;
+	}
+
+public:
+	void initial(ModelUpdate* ada) {
+		_ada = ada;
+		_step = 0;
+		_tables.clear();
+		_param_tables.assign(_ada->_params.size(), -1);
+		_rows.clear();
+		_touched.clear();
+		_last_update.clear();
+	}
+
+	// returns the table index for touch(), or -1 if its embeddings are not tuned
+	int addTable(LookupTable* table) {
+		int param_index = -1;
+		for (int idx = 0; idx < _ada->_params.size(); idx++) {
+			if (_ada->_params[idx] == &table->E)
+				param_index = idx;
+		}
+		if (param_index < 0)
+			return -1;
+		int table_index = _tables.size();
+		_tables.push_back(table);
+		_param_tables[param_index] = table_index;
+		_rows.push_back(vector<int>());
+		_touched.push_back(vector<bool>(table->nVSize, false));
+		_last_update.push_back(vector<int>(table->nVSize, 0));
+		return table_index;
+	}
+
+	// records the rows of ids, unknown ids as in LookupNode
+	void touch(int table_index, const int* ids, int num) {
+		if (table_index < 0)
+			return;
+		LookupTable* table = _tables[table_index];
+		vector<bool>& touched = _touched[table_index];
+		for (int idx = 0; idx < num; idx++) {
+			int xid = ids[idx] < 0 ? table->nUNKId : ids[idx];
+			if (xid < 0 || touched[xid])
+				continue;
+			touched[xid] = true;
+			_rows[table_index].push_back(xid);
+		}
+	}
+
+	void update(dtype maxScale) {
+		dtype sumNorm = 0.0;
+		for (int idx = 0; idx < _ada->_params.size(); idx++) {
+			if (_param_tables[idx] < 0)
+				sumNorm += _ada->_params[idx]->squareGradNorm();
+			else
+				sumNorm += squareGradNorm(_param_tables[idx]);
+		}
+		if (std::isnan(double(sumNorm)) || sumNorm > 1e20) { //too large
+			clearGrad();
+			return;
+		}
+		dtype norm = sqrt(sumNorm);
+		if (maxScale > 0 && norm > maxScale) {
+			dtype scale = maxScale / norm;
+			for (int idx = 0; idx < _ada->_params.size(); idx++) {
+				if (_param_tables[idx] < 0)
+					_ada->_params[idx]->rescaleGrad(scale);
+				else
+					rescaleGrad(_param_tables[idx], scale);
+			}
+		}
+
+		_step++;
+		for (int idx = 0; idx < _ada->_params.size(); idx++) {
+			if (_param_tables[idx] < 0)
+				_ada->_params[idx]->updateAdagrad(_ada->_alpha, _ada->_reg, _ada->_eps);
+			else
+				updateAdagrad(_param_tables[idx]);
+		}
+		clearGrad();
+	}
+
+	void clearGrad() {
+		for (int idx = 0; idx < _ada->_params.size(); idx++) {
+			if (_param_tables[idx] < 0)
+				_ada->_params[idx]->clearGrad();
+			else
+				clearGrad(_param_tables[idx]);
+		}
+	}
+
+private:
+	dtype squareGradNorm(int table_index) {
+		SparseParam& E = _tables[table_index]->E;
+		const vector<int>& rows = _rows[table_index];
+		dtype sumNorm = 0.0;
+		for (int idx = 0; idx < rows.size(); idx++) {
+			for (int idy = 0; idy < E.grad.row; idy++)
+				sumNorm += E.grad[rows[idx]][idy] * E.grad[rows[idx]][idy];
+		}
+		return sumNorm;
+	}
+
+	void rescaleGrad(int table_index, dtype scale) {
+		SparseParam& E = _tables[table_index]->E;
+		const vector<int>& rows = _rows[table_index];
+		for (int idx = 0; idx < rows.size(); idx++) {
+			for (int idy = 0; idy < E.grad.row; idy++)
+				E.grad[rows[idx]][idy] *= scale;
+		}
+	}
+
+	void updateAdagrad(int table_index) {
+		SparseParam& E = _tables[table_index]->E;
+		const vector<int>& rows = _rows[table_index];
+		vector<int>& last_update = _last_update[table_index];
+		dtype alpha = _ada->_alpha, reg = _ada->_reg, eps = _ada->_eps;
+		for (int idx = 0; idx < rows.size(); idx++) {
+			int index = rows[idx];
+			// the regularization-only steps since the last update, their tiny squares are left out of aux_square
+			int missed = _step - last_update[index] - 1;
+			for (int idy = 0; idy < E.val.row; idy++) {
+				if (reg > 0 && missed > 0)
+					E.val[index][idy] *= pow(1 - alpha * reg / sqrt(E.aux_square[index][idy] + eps), missed);
+				E.grad[index][idy] = E.grad[index][idy] + E.val[index][idy] * reg;
+				E.aux_square[index][idy] = E.aux_square[index][idy] + E.grad[index][idy] * E.grad[index][idy];
+				E.val[index][idy] = E.val[index][idy] - E.grad[index][idy] * alpha / sqrt(E.aux_square[index][idy] + eps);
+			}
+			last_update[index] = _step;
+		}
+	}
+
+	void clearGrad(int table_index) {
+		SparseParam& E = _tables[table_index]->E;
+		vector<int>& rows = _rows[table_index];
+		vector<bool>& touched = _touched[table_index];
+		for (int idx = 0; idx < rows.size(); idx++) {
+			int index = rows[idx];
+			for (int idy = 0; idy < E.grad.row; idy++)
+				E.grad[index][idy] = 0;
+			E.indexers[index] = false;
+			touched[index] = false;
+		}
+		rows.clear();
+	}
+
+private:
+	ModelUpdate* _ada;
+	int _step;
+	vector<LookupTable*> _tables;
+	vector<int> _param_tables; // table index of every parameter of _ada, -1 for dense ones
+	vector<vector<int> > _rows;
+	vector<vector<bool> > _touched;
+	vector<vector<int> > _last_update;
+};
+
+#endif /*_LAZY_SPARSE_UPDATE_H_*/
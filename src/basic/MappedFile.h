@@ -0,0 +1,97 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <string>
+#include <fstream>
+#include <iterator>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/*
+ the bytes of a whole file, read only, for the parsers that cut a file into ranges.
+ the file is mapped where mmap exists and read into a buffer of its own on windows.
+ */
+class MappedFile {
+public:
+	MappedFile() {
+		_data = NULL;
+		_size = 0;
+	}
+
+	~MappedFile() {
+		close();
+	}
+
+public:
+	// false if the file can not be read, an empty file has size() 0
+	bool open(const string& file) {
+		close();
+#if defined(_WIN32)
+		ifstream is(file.c_str(), ios::binary);
+		if (!is.is_open())
+			return false;
+		_buffer.assign(istreambuf_iterator<char>(is), istreambuf_iterator<char>());
+		_data = _buffer.data();
+		_size = _buffer.size();
+		return true;
+#else
+		int fd = ::open(file.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) < 0) {
+			::close(fd);
+			return false;
+		}
+		if (st.st_size == 0) {
+			::close(fd);
+			return true;
+		}
+		void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (mapped == MAP_FAILED)
+			return false;
+		_data = (const char*)mapped;
+		_size = st.st_size;
+		return true;
+#endif
+	}
+
+	void close() {
+#if defined(_WIN32)
+		string().swap(_buffer);
+#else
+		if (_data != NULL)
+			munmap((void*)_data, _size);
+#endif
+		_data = NULL;
+		_size = 0;
+	}
+
+	const char* data() const {
+		return _data;
+	}
+
+	size_t size() const {
+		return _size;
+	}
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+private:
+	const char* _data;
+	size_t _size;
+#if defined(_WIN32)
+	string _buffer;
+#endif
+};
+
+#endif /*_MAPPED_FILE_H_*/
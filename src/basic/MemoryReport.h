@@ -0,0 +1,154 @@
+#ifndef _MEMORY_REPORT_H_
+#define _MEMORY_REPORT_H_
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <mutex>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include "N3L.h"
+#include "Example.h"
+
+using namespace std;
+
+/*
+ the memory a driver holds once initial() or TestInitial() is done, by what it is for.
+ parameters and optimizer state (gradients and adagrad accumulators) are counted from
+ the shapes of the exported parameters, so they are exact wherever they were allocated.
+ graph nodes are counted as the growth of the heap while the graphs are created:
+ exact with the default -memsize 0, where every tensor is allocated on the heap at its
+ own size, and only the part that did not fit when a fixed pool is given.
+ the graphs grow afterwards, when reserve() rebuilds them for longer sentences and their
+ sequence buffers are resized, so sample() keeps the peak of the heap after each batch and
+ printPeak() reports it with its growth over the heap of the last print().
+ the lengths of the corpora given to addCorpus() size the graphs initial() creates, so that
+ training does not rebuild them; unlike the byte counts they outlive reset().
+ */
+class MemoryReport {
+public:
+	MemoryReport() {
+		_sentences = _max_words = _max_chars = 0;
+		reset();
+	}
+
+	void reset() {
+		_params = _optimizer = _graphs = _mark = 0;
+		_base = _peak = 0;
+	}
+
+	// bytes the allocator has handed out, 0 where it can not tell
+	static size_t heapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+		struct mallinfo2 info = mallinfo2();
+		return info.uordblks + info.hblkhd;
+#elif defined(__GLIBC__)
+		// the int fields of mallinfo wrap beyond 4 GB
+		struct mallinfo info = mallinfo();
+		return size_t((unsigned int)info.uordblks) + size_t((unsigned int)info.hblkhd);
+#else
+		return 0;
+#endif
+	}
+
+	// the longest sentence, in words and in chars, before the graphs are created
+	void addCorpus(const vector<Example>& examples) {
+		for (int idx = 0; idx < examples.size(); idx++) {
+			const Feature& feature = examples[idx].m_feature;
+			if (feature.wordNum() > _max_words)
+				_max_words = feature.wordNum();
+			if (feature.charNum() > _max_chars)
+				_max_chars = feature.charNum();
+		}
+		_sentences += examples.size();
+	}
+
+	// 0 without a corpus
+	int maxWords() const {
+		return _max_words;
+	}
+
+	int maxChars() const {
+		return _max_chars;
+	}
+
+	// every exported parameter with its gradient and accumulators, a replica included
+	void addParams(const ModelUpdate& ada) {
+		for (int idx = 0; idx < ada._params.size(); idx++) {
+			BaseParam* param = ada._params[idx];
+			_params += bytes(param->val);
+			_optimizer += bytes(param->grad);
+			Param* dense = dynamic_cast<Param*>(param);
+			if (dense != NULL)
+				_optimizer += bytes(dense->aux_square) + bytes(dense->aux_mean);
+			SparseParam* sparse = dynamic_cast<SparseParam*>(param);
+			if (sparse != NULL)
+				_optimizer += bytes(sparse->aux_square) + bytes(sparse->aux_mean);
+		}
+	}
+
+	// the graphs created in between are counted
+	void beginGraphs() {
+		_mark = heapInUse();
+	}
+
+	void endGraphs() {
+		size_t now = heapInUse();
+		if (now > _mark)
+			_graphs += now - _mark;
+	}
+
+	// after a batch, from any thread
+	void sample() {
+		size_t now = heapInUse();
+		lock_guard<mutex> guard(_lock);
+		if (now > _peak)
+			_peak = now;
+	}
+
+	void print(const string& phase, int poolSize) {
+		std::cout << "memory after " << phase << ":" << std::endl;
+		std::cout << "parameters = " << megabytes(_params) << " MB" << std::endl;
+		std::cout << "optimizer state = " << megabytes(_optimizer) << " MB" << std::endl;
+		std::cout << "graph nodes = " << megabytes(_graphs) << " MB" << std::endl;
+		if (_sentences > 0)
+			std::cout << "longest sentence = " << _max_words << " words, " << _max_chars << " chars of "
+				<< _sentences << " sentences" << std::endl;
+		std::cout << "total = " << megabytes(_params + _optimizer + _graphs) << " MB"
+			<< ", pool = " << megabytes(poolSize) << " MB, heap in use = " << megabytes(heapInUse()) << " MB" << std::endl;
+		_base = heapInUse();
+		sample();
+	}
+
+	void printPeak(const string& phase) {
+		sample();
+		std::cout << "memory peak during " << phase << ": heap in use = " << megabytes(_peak)
+			<< " MB, grown since setup = " << megabytes(_peak > _base ? _peak - _base : 0) << " MB" << std::endl;
+	}
+
+private:
+	static size_t bytes(const Tensor2D& tensor) {
+		return tensor.v == NULL ? 0 : sizeof(dtype) * tensor.row * tensor.col;
+	}
+
+	static string megabytes(size_t count) {
+		ostringstream out;
+		out << std::fixed << std::setprecision(2) << count / (1024.0 * 1024.0);
+		return out.str();
+	}
+
+private:
+	size_t _params;
+	size_t _optimizer;
+	size_t _graphs;
+	size_t _mark;
+	size_t _base; // the heap at the last print()
+	size_t _peak;
+	size_t _sentences;
+	int _max_words;
+	int _max_chars;
+	mutex _lock;
+};
+
+#endif /*_MEMORY_REPORT_H_*/
@@ -0,0 +1,396 @@
+#ifndef _MODEL_FILE_H_
+#define _MODEL_FILE_H_
+
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "N3L.h"
+
+using namespace std;
+
+/*
+ the binary model file shared by all labelers.
+ a header (magic, version, sizeof(dtype) and the labeler name) is followed by the
+ hyperparameters, alphabets and parameters in the order the labeler writes them.
+ every matrix is stored column-major like Tensor2D, starting at a MODEL_FILE_ALIGN boundary,
+ so that ModelReader can map the file and point the tensors at it instead of copying.
+ the mapping is private: the pages are shared between processes until someone writes them.
+ on windows the file is read into an aligned buffer of the reader instead.
+ */
+#define MODEL_FILE_MAGIC "N3LM"
+#define MODEL_FILE_VERSION 2 // 2: no execution flags in the hyperparameters
+#define MODEL_FILE_ALIGN 64
+
+class ModelWriter {
+public:
+	ModelWriter() {
+	}
+
+	~ModelWriter() {
+		close();
+	}
+
+public:
+	bool open(const string& file, const string& name) {
+		close();
+		_os.open(file.c_str(), ios::binary);
+		if (!_os.is_open())
+			return false;
+		_os.write(MODEL_FILE_MAGIC, 4);
+		write(int(MODEL_FILE_VERSION));
+		write(int(sizeof(dtype)));
+		write(name);
+		return _os.good();
+	}
+
+	void close() {
+		if (_os.is_open())
+			_os.close();
+	}
+
+	bool good() const {
+		return _os.good();
+	}
+
+	void write(int value) {
+		_os.write((const char*)&value, sizeof(int));
+	}
+
+	void write(bool value) {
+		write(int(value));
+	}
+
+	void write(dtype value) {
+		_os.write((const char*)&value, sizeof(dtype));
+	}
+
+	void write(const string& value) {
+		write(int(value.size()));
+		_os.write(value.data(), value.size());
+	}
+
+	void write(const Alphabet& alpha) {
+		write(alpha.size());
+		for (int idx = 0; idx < alpha.size(); idx++)
+			write(string(alpha.from_id(idx)));
+	}
+
+	void write(const vector<int>& values) {
+		write(int(values.size()));
+		_os.write((const char*)values.data(), sizeof(int) * values.size());
+	}
+
+	// count values from a MODEL_FILE_ALIGN boundary on
+	void writeValues(const dtype* values, int count) {
+		long offset = _os.tellp();
+		while (offset % MODEL_FILE_ALIGN != 0) {
+			_os.put(0);
+			offset++;
+		}
+		_os.write((const char*)values, sizeof(dtype) * count);
+	}
+
+	void write(const Tensor2D& mat) {
+		write(mat.row);
+		write(mat.col);
+		writeValues(mat.v, mat.row * mat.col);
+	}
+
+	void write(const LookupTable& table) {
+		write(table.nDim);
+		write(table.bFineTune);
+		write(table.E.val);
+	}
+
+	void write(const UniParams& params) {
+		write(params.bUseB);
+		write(params.W.val);
+		write(params.b.val);
+	}
+
+	void write(const BiParams& params) {
+		write(params.bUseB);
+		write(params.W1.val);
+		write(params.W2.val);
+		write(params.b.val);
+	}
+
+	void write(const RNNParams& params) {
+		write(params._rnn);
+	}
+
+	void write(const GRNNParams& params) {
+		write(params._rnn_update);
+		write(params._rnn_reset);
+		write(params._rnn);
+	}
+
+	void write(const LSTMParams& params) {
+		write(params.input);
+		write(params.output);
+		write(params.forget);
+		write(params.cell);
+	}
+
+private:
+	ofstream _os;
+};
+
+class ModelReader {
+public:
+	ModelReader() {
+		_data = NULL;
+		_size = _offset = 0;
+		_good = false;
+	}
+
+	~ModelReader() {
+		close();
+	}
+
+public:
+	// maps the file and checks its header, name is the labeler that wrote it
+	bool open(const string& file, const string& name) {
+		close();
+		if (!load(file))
+			return false;
+		_offset = 0;
+		_good = true;
+
+		const char* magic = take(4);
+		int version = 0, dtype_size = 0;
+		string model_name;
+		read(version);
+		read(dtype_size);
+		read(model_name);
+		if (!_good || string(magic, 4) != MODEL_FILE_MAGIC || version != MODEL_FILE_VERSION
+			|| dtype_size != sizeof(dtype) || model_name != name) {
+			std::cout << "model file " << file << " is not a version " << MODEL_FILE_VERSION << " model of " << name << std::endl;
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	// gives the bound tensors their own buffers and shapes back and unmaps the file
+	void close() {
+		for (int idx = 0; idx < _bound.size(); idx++) {
+			Tensor2D* mat = _bound[idx].mat;
+			mat->v = _bound[idx].v;
+			mat->row = _bound[idx].row;
+			mat->col = _bound[idx].col;
+			mat->size = mat->row * mat->col;
+		}
+		_bound.clear();
+		if (_data != NULL) {
+#if defined(_WIN32)
+			_aligned_free(_data);
+#else
+			munmap(_data, _size);
+#endif
+		}
+		_data = NULL;
+		_size = _offset = 0;
+		_good = false;
+	}
+
+	bool good() const {
+		return _good;
+	}
+
+	void read(int& value) {
+		const char* p = take(sizeof(int));
+		value = p == NULL ? 0 : *(const int*)p;
+	}
+
+	void read(bool& value) {
+		int flag;
+		read(flag);
+		value = flag != 0;
+	}
+
+	void read(dtype& value) {
+		const char* p = take(sizeof(dtype));
+		value = p == NULL ? 0 : *(const dtype*)p;
+	}
+
+	void read(string& value) {
+		int len;
+		read(len);
+		const char* p = len < 0 ? NULL : take(len);
+		if (p == NULL)
+			value.clear();
+		else
+			value.assign(p, len);
+	}
+
+	// the ids are those of the written alphabet, which is fixed afterwards
+	void read(Alphabet& alpha) {
+		int num;
+		read(num);
+		alpha.clear();
+		string elem;
+		for (int idx = 0; idx < num && _good; idx++) {
+			read(elem);
+			alpha.from_string(elem);
+		}
+		alpha.set_fixed_flag(true);
+	}
+
+	void read(vector<int>& values) {
+		int num;
+		read(num);
+		const char* p = num < 0 ? NULL : take(sizeof(int) * num);
+		if (p == NULL)
+			values.clear();
+		else
+			values.assign((const int*)p, (const int*)p + num);
+	}
+
+	// the values written by writeValues, in place in the mapping
+	const dtype* readValues(int count) {
+		take((MODEL_FILE_ALIGN - _offset % MODEL_FILE_ALIGN) % MODEL_FILE_ALIGN);
+		return count < 0 ? NULL : (const dtype*)take(sizeof(dtype) * count);
+	}
+
+	// mat takes the written shape and its values live in the file, nothing is allocated
+	void read(Tensor2D& mat) {
+		int row, col;
+		read(row);
+		read(col);
+		if (row < 0 || col < 0)
+			_good = false;
+		const dtype* p = readValues(row * col);
+		if (p == NULL)
+			return;
+		BoundTensor bound;
+		bound.mat = &mat;
+		bound.v = mat.v;
+		bound.row = mat.row;
+		bound.col = mat.col;
+		_bound.push_back(bound);
+		mat.v = row * col == 0 ? NULL : (dtype*)p;
+		mat.row = row;
+		mat.col = col;
+		mat.size = row * col;
+	}
+
+	// the fields LookupTable::initial would set, with E.val in the file and no gradients
+	void read(LookupTable& table, PAlphabet elems) {
+		int dim;
+		bool bFineTune;
+		read(dim);
+		read(bFineTune);
+		if (!_good)
+			return;
+		table.elems = elems;
+		table.nVSize = elems->size();
+		table.nUNKId = elems->from_string(unknownkey);
+		table.nDim = dim;
+		table.bFineTune = bFineTune;
+		read(table.E.val);
+		if (table.E.val.row != dim || table.E.val.col != table.nVSize)
+			_good = false;
+	}
+
+	void read(UniParams& params) {
+		read(params.bUseB);
+		read(params.W.val);
+		read(params.b.val);
+	}
+
+	void read(BiParams& params) {
+		read(params.bUseB);
+		read(params.W1.val);
+		read(params.W2.val);
+		read(params.b.val);
+	}
+
+	void read(RNNParams& params) {
+		read(params._rnn);
+	}
+
+	void read(GRNNParams& params) {
+		read(params._rnn_update);
+		read(params._rnn_reset);
+		read(params._rnn);
+	}
+
+	void read(LSTMParams& params) {
+		read(params.input);
+		read(params.output);
+		read(params.forget);
+		read(params.cell);
+	}
+
+private:
+	// _data and _size of the whole file
+	bool load(const string& file) {
+#if defined(_WIN32)
+		ifstream is(file.c_str(), ios::binary | ios::ate);
+		if (!is.is_open())
+			return false;
+		size_t size = is.tellg();
+		if (size == 0)
+			return false;
+		char* data = (char*)_aligned_malloc(size, MODEL_FILE_ALIGN);
+		if (data == NULL)
+			return false;
+		is.seekg(0);
+		if (!is.read(data, size)) {
+			_aligned_free(data);
+			return false;
+		}
+		_data = data;
+		_size = size;
+		return true;
+#else
+		int fd = ::open(file.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) < 0 || st.st_size == 0) {
+			::close(fd);
+			return false;
+		}
+		void* data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (data == MAP_FAILED)
+			return false;
+		_data = (char*)data;
+		_size = st.st_size;
+		return true;
+#endif
+	}
+
+	const char* take(size_t bytes) {
+		if (!_good || _offset + bytes > _size) {
+			_good = false;
+			return NULL;
+		}
+		const char* p = _data + _offset;
+		_offset += bytes;
+		return p;
+	}
+
+private:
+	// a tensor pointing into the file and what it had before
+	struct BoundTensor {
+		Tensor2D* mat;
+		dtype* v;
+		int row, col;
+	};
+
+	char* _data;
+	size_t _size;
+	size_t _offset;
+	bool _good;
+	vector<BoundTensor> _bound;
+};
+
+#endif /*_MODEL_FILE_H_*/
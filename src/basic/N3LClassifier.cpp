@@ -0,0 +1,114 @@
+/*
+ the api of N3LClassifier.h over the Classifier of a labeler,
+ compiled into the library of every labeler together with its NNCNNLabeler.cpp.
+ */
+#include "NNCNNLabeler.h"
+#include "N3LClassifier.h"
+
+struct n3l_classifier {
+	Classifier classifier;
+	mutex graph_mutex;
+	condition_variable graph_cond;
+	vector<ComputionGraph*> free_graphs;  // the graphs of m_driver._pcgs no predict is running on
+
+	n3l_classifier() : classifier(0) {
+	}
+
+	ComputionGraph* acquire() {
+		unique_lock<mutex> lock(graph_mutex);
+		graph_cond.wait(lock, [this]() { return !free_graphs.empty(); });
+		ComputionGraph* pcg = free_graphs.back();
+		free_graphs.pop_back();
+		return pcg;
+	}
+
+	void release(ComputionGraph* pcg) {
+		unique_lock<mutex> lock(graph_mutex);
+		free_graphs.push_back(pcg);
+		graph_cond.notify_one();
+	}
+};
+
+n3l_classifier* n3l_classifier_load(const char* modelFile, int threads) {
+	if (modelFile == NULL)
+		return NULL;
+	n3l_classifier* classifier = NULL;
+	try {
+		classifier = new n3l_classifier();
+		Driver& driver = classifier->classifier.m_driver;
+		classifier->classifier.loadModelFile(modelFile);
+		if (!driver._model_file.good() || !driver._hyperparams.bValid()) {
+			delete classifier;
+			return NULL;
+		}
+		driver.TestInitial(threads < 1 ? 1 : threads);
+		classifier->free_graphs = driver._pcgs;
+		return classifier;
+	}
+	catch (...) {
+		delete classifier;
+		return NULL;
+	}
+}
+
+void n3l_classifier_free(n3l_classifier* classifier) {
+	delete classifier;
+}
+
+int n3l_classifier_label_num(const n3l_classifier* classifier) {
+	return classifier == NULL ? 0 : classifier->classifier.m_driver._modelparams.labelAlpha.size();
+}
+
+const char* n3l_classifier_label(const n3l_classifier* classifier, int label) {
+	if (label < 0 || label >= n3l_classifier_label_num(classifier))
+		return NULL;
+	return classifier->classifier.m_driver._modelparams.labelAlpha.from_id(label).c_str();
+}
+
+int n3l_classifier_predict(n3l_classifier* classifier, const char* const* const* texts, const int* word_nums, int num,
+	int* labels, double* probs) {
+	if (classifier == NULL || num < 0 || (num > 0 && (texts == NULL || word_nums == NULL || labels == NULL)))
+		return -1;
+	try {
+		// the features only read the fixed alphabets, so they need no graph
+		Classifier& the_classifier = classifier->classifier;
+		vector<Example> examples(num);
+		vector<const Example*> pexamples(num);
+		Instance inst;
+		for (int idx = 0; idx < num; idx++) {
+			inst.m_tweet.assign(texts[idx], texts[idx] + (word_nums[idx] > 0 ? word_nums[idx] : 0));
+			the_classifier.convert2Example(&inst, examples[idx]);
+			pexamples[idx] = &examples[idx];
+		}
+		the_classifier.initialIds(examples);
+
+		ModelParams& params = the_classifier.m_driver._modelparams;
+		int label_num = params.labelAlpha.size();
+		vector<dtype> label_probs(label_num);
+		ComputionGraph* pcg = classifier->acquire();
+		try {
+			the_classifier.m_driver.reserve(pcg, pexamples, 0, num);
+			for (int idx = 0; idx < num; idx++) {
+				if (word_nums[idx] <= 0) {
+					labels[idx] = -1;
+					if (probs != NULL)
+						std::fill(probs + idx * label_num, probs + (idx + 1) * label_num, 0.0);
+					continue;
+				}
+				pcg->forward(examples[idx].m_feature);
+				params.loss.predict(&pcg->_output, labels[idx], label_probs.data());
+				if (probs != NULL)
+					std::copy(label_probs.begin(), label_probs.end(), probs + idx * label_num);
+			}
+		}
+		catch (...) {
+			classifier->release(pcg);
+			throw;
+		}
+		classifier->release(pcg);
+		return 0;
+	}
+	catch (...) {
+		return -1;
+	}
+}
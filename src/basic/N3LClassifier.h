@@ -0,0 +1,102 @@
+#ifndef _N3L_CLASSIFIER_H_
+#define _N3L_CLASSIFIER_H_
+
+/*
+ the api of the labeler libraries, libNN*Labeler.so, one per architecture.
+ a classifier loads a model written by the labeler of the same architecture and
+ keeps a pool of graphs over it, so that predict can be called from several
+ threads at once, each call running on a graph of its own.
+ a text is an array of tokens, as the words of a corpus line.
+ */
+#if defined(__GNUC__)
+#define N3L_API __attribute__((visibility("default")))
+#else
+#define N3L_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct n3l_classifier n3l_classifier;
+
+// NULL if the model can not be loaded, threads is the number of concurrent predictions
+N3L_API n3l_classifier* n3l_classifier_load(const char* modelFile, int threads);
+
+N3L_API void n3l_classifier_free(n3l_classifier* classifier);
+
+N3L_API int n3l_classifier_label_num(const n3l_classifier* classifier);
+
+// the name of a label id
+N3L_API const char* n3l_classifier_label(const n3l_classifier* classifier, int label);
+
+// labels[idx] gets the label id of texts[idx], which has word_nums[idx] tokens, or -1 if it has none.
+// probs, if not NULL, gets the label_num probabilities of every text. returns 0 on success.
+N3L_API int n3l_classifier_predict(n3l_classifier* classifier, const char* const* const* texts, const int* word_nums, int num,
+	int* labels, double* probs);
+
+#ifdef __cplusplus
+}
+
+#include <string>
+#include <vector>
+
+// the api for c++ callers
+class N3LClassifier {
+public:
+	N3LClassifier() {
+		_classifier = NULL;
+	}
+
+	~N3LClassifier() {
+		n3l_classifier_free(_classifier);
+	}
+
+public:
+	bool load(const std::string& modelFile, int threads = 1) {
+		n3l_classifier_free(_classifier);
+		_classifier = n3l_classifier_load(modelFile.c_str(), threads);
+		return _classifier != NULL;
+	}
+
+	int labelNum() const {
+		return n3l_classifier_label_num(_classifier);
+	}
+
+	std::string label(int id) const {
+		const char* name = n3l_classifier_label(_classifier, id);
+		return name == NULL ? "" : name;
+	}
+
+	// labels[idx] is empty for a text without tokens
+	bool predict(const std::vector<std::vector<std::string> >& texts, std::vector<std::string>& labels, std::vector<double>* probs = NULL) {
+		int num = texts.size();
+		std::vector<std::vector<const char*> > tokens(num);
+		std::vector<const char* const*> pTexts(num);
+		std::vector<int> word_nums(num), ids(num);
+		for (int idx = 0; idx < num; idx++) {
+			for (int idy = 0; idy < texts[idx].size(); idy++)
+				tokens[idx].push_back(texts[idx][idy].c_str());
+			pTexts[idx] = tokens[idx].data();
+			word_nums[idx] = tokens[idx].size();
+		}
+		if (probs != NULL)
+			probs->resize(num * labelNum());
+		if (n3l_classifier_predict(_classifier, pTexts.data(), word_nums.data(), num, ids.data(), probs == NULL ? NULL : probs->data()) != 0)
+			return false;
+		labels.resize(num);
+		for (int idx = 0; idx < num; idx++)
+			labels[idx] = ids[idx] < 0 ? "" : label(ids[idx]);
+		return true;
+	}
+
+private:
+	N3LClassifier(const N3LClassifier&);
+	N3LClassifier& operator=(const N3LClassifier&);
+
+private:
+	n3l_classifier* _classifier;
+};
+#endif
+
+#endif /*_N3L_CLASSIFIER_H_*/
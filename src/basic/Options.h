@@ -20,6 +20,14 @@ public:
   dtype initRange;
   int maxIter;
   int batchSize;
+  int threads;
+  bool batchRNN;
+  int bucketWidth;
+  bool hoistRNN;
+  bool parallelBranches;
+  bool asyncEval;
+  int serveBatch;
+  int serveWait;
   dtype adaEps;
   dtype adaAlpha;
   dtype regParameter;
@@ -68,6 +76,14 @@ public:
     initRange = 0.01;
     maxIter = 1000;
     batchSize = 1;
+    threads = 1;
+    batchRNN = false;
+    bucketWidth = 0;
+    hoistRNN = true;
+    parallelBranches = false;
+    asyncEval = false;
+    serveBatch = 32;
+    serveWait = 1000;
     adaEps = 1e-6;
     adaAlpha = 0.01;
     regParameter = 1e-8;
@@ -128,6 +144,22 @@ public:
         maxIter = atoi(pr.second.c_str());
       if (pr.first == "batchSize")
         batchSize = atoi(pr.second.c_str());
+      if (pr.first == "threads")
+        threads = atoi(pr.second.c_str());
+      if (pr.first == "batchRNN")
+        batchRNN = (pr.second == "true") ? true : false;
+      if (pr.first == "bucketWidth")
+        bucketWidth = atoi(pr.second.c_str());
+      if (pr.first == "hoistRNN")
+        hoistRNN = (pr.second == "true") ? true : false;
+      if (pr.first == "parallelBranches")
+        parallelBranches = (pr.second == "true") ? true : false;
+      if (pr.first == "asyncEval")
+        asyncEval = (pr.second == "true") ? true : false;
+      if (pr.first == "serveBatch")
+        serveBatch = atoi(pr.second.c_str());
+      if (pr.first == "serveWait")
+        serveWait = atoi(pr.second.c_str());
       if (pr.first == "adaEps")
         adaEps = atof(pr.second.c_str());
       if (pr.first == "adaAlpha")
@@ -207,6 +239,14 @@ public:
     std::cout << "initRange = " << initRange << std::endl;
     std::cout << "maxIter = " << maxIter << std::endl;
     std::cout << "batchSize = " << batchSize << std::endl;
+    std::cout << "threads = " << threads << std::endl;
+    std::cout << "batchRNN = " << batchRNN << std::endl;
+    std::cout << "bucketWidth = " << bucketWidth << std::endl;
+    std::cout << "hoistRNN = " << hoistRNN << std::endl;
+    std::cout << "parallelBranches = " << parallelBranches << std::endl;
+    std::cout << "asyncEval = " << asyncEval << std::endl;
+    std::cout << "serveBatch = " << serveBatch << std::endl;
+    std::cout << "serveWait = " << serveWait << std::endl;
     std::cout << "adaEps = " << adaEps << std::endl;
     std::cout << "adaAlpha = " << adaAlpha << std::endl;
     std::cout << "regParameter = " << regParameter << std::endl;
@@ -0,0 +1,71 @@
+#ifndef _PARALLEL_BRANCH_H_
+#define _PARALLEL_BRANCH_H_
+
+#include "N3L.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+/*
+ an independent branch of a graph, e.g., the char pipeline of the *Char labelers,
+ built on its own sub-graph by a thread of its own.
+ begin() starts building (and thereby computing) the branch, join() waits for it and
+ puts this node into the main graph ahead of the node that consumes the branch.
+ its backward, reached right after that consumer's, starts the backward of the branch,
+ which overlaps the rest of the main backward until wait().
+ in serial mode the branch is built on the main graph itself and nothing else happens.
+ */
+class ParallelBranch : public Node {
+public:
+	Graph _graph;
+	ThreadPool _pool;
+	future<void> _task;
+	bool _parallel;
+
+public:
+	ParallelBranch() : Node() {
+		_parallel = false;
+	}
+
+	inline void init(bool parallel) {
+		_parallel = parallel;
+		if (_parallel)
+			_pool.start(1);
+	}
+
+	// drops the nodes of the last branch, e.g., before the graph destroys them
+	inline void release() {
+		_graph.clearValue();
+	}
+
+	inline void begin(Graph* cg, const function<void(Graph*)>& build) {
+		if (!_parallel) {
+			build(cg);
+			return;
+		}
+		_graph.clearValue(cg->train);
+		_task = _pool.push([this, build]() { build(&_graph); });
+	}
+
+	inline void join(Graph* cg) {
+		if (!_parallel)
+			return;
+		_task.get();
+		cg->addNode(this);
+	}
+
+	inline void compute() {
+	}
+
+	inline void backward() {
+		_task = _pool.push([this]() { _graph.backward(); });
+	}
+
+	// must follow the backward of the main graph
+	inline void wait() {
+		if (_task.valid())
+			_task.get();
+	}
+};
+
+#endif /*_PARALLEL_BRANCH_H_*/
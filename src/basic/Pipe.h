@@ -10,6 +10,7 @@
 #include "Instance.h"
 #include "InstanceReader.h"
 #include "InstanceWriter.h"
+#include "CorpusReader.h"
 #include <iterator>
 
 using namespace std;
@@ -22,6 +23,7 @@ public:
     m_jstReader = new InstanceReader();
     m_jstWriter = new InstanceWriter();
 	max_sentense_size = 256;
+	threads = 1;
   }
 
   ~Pipe(void) {
@@ -83,35 +85,16 @@ public:
   }
 
   void readInstances(const string& m_strInFile, vector<Instance>& vecInstances, int maxInstance = -1) {
-    vecInstances.clear();
-    initInputFile(m_strInFile.c_str());
-
-    Instance *pInstance = nextInstance();
-    int numInstance = 0;
-
-    while (pInstance) {
-
-        Instance trainInstance;
-        trainInstance.copyValuesFrom(*pInstance);
-        vecInstances.push_back(trainInstance);
-        numInstance++;
-
-        if (numInstance == maxInstance) {
-          break;
-        }
-
-      pInstance = nextInstance();
-
-    }
-
-    uninitInputFile();
+    CorpusReader reader(threads);
+    reader.readInstances(m_strInFile, vecInstances, maxInstance);
 
     cout << endl;
-    cout << "instance num: " << numInstance << endl;
+    cout << "instance num: " << vecInstances.size() << endl;
   }
 
 public:
 	int max_sentense_size;
+	int threads; // of readInstances
 
 protected:
   Reader *m_jstReader;
@@ -0,0 +1,379 @@
+#ifndef _SEQUENCE_NODES_H_
+#define _SEQUENCE_NODES_H_
+
+#include "BatchRecurrent.h"
+
+using namespace std;
+
+/*
+ nodes holding a whole sentence in one column-major matrix, step t being column t,
+ the layout of BatchRecurrent.h for a batch of one.
+ they replace the per-step WindowBuilder, UniNode and ConcatNode chains of the graphs:
+ a window is one pass over contiguous columns and a hidden layer is one GEMM over all
+ steps, instead of one small node per word chasing the pointers of its inputs.
+ PoolingSeqNode pools a sequence into the per-step nodes of the library above it,
+ SeqStepNode hands single steps to the others.
+ a graph that only decodes gives its nodes no losses and computes activations in place.
+ */
+
+// Node::init without the loss and drop mask, for the nodes of a graph that only decodes
+inline void initValue(Node& node, int ndim, dtype dropout, AlignedMemoryPool* mem) {
+	node.dim = ndim;
+	node.val.init(ndim, mem);
+	node.drop_value = dropout > 0 && dropout <= 1 ? dropout : -1;
+}
+
+// a node whose value is a dim * steps matrix
+class SeqNode : public Node {
+public:
+	bool _bTrain;
+
+public:
+	SeqNode() : Node() {
+		_bTrain = false;
+	}
+
+	virtual BatchMat& seqVal() = 0;
+	// filled by the consumers before backward, training only
+	virtual BatchMat& seqLoss() = 0;
+
+	inline int steps() {
+		return seqVal().cols();
+	}
+};
+
+// a SeqNode owning its matrices, with the dropout of Node::forward_drop on every step
+class MatSeqNode : public SeqNode {
+public:
+	int _dim;
+	BatchMat _vals;
+	BatchMat _losses;
+	BatchMat _drop_masks;
+	dtype _drop_value;
+	mt19937 _generator;
+
+public:
+	MatSeqNode() : SeqNode() {
+		_dim = 0;
+		_drop_value = -1;
+	}
+
+	inline void init(int ndim, dtype dropout) {
+		_dim = ndim;
+		_drop_value = dropout;
+		_generator.seed(rand());
+	}
+
+	inline BatchMat& seqVal() {
+		return _vals;
+	}
+
+	inline BatchMat& seqLoss() {
+		return _losses;
+	}
+
+protected:
+	// once compute has filled _vals
+	inline void forwardDrop() {
+		int steps = _vals.cols();
+		if (_drop_value > 0 && _bTrain) {
+			batchDropMask(_drop_masks, _dim, steps, _drop_value, _generator);
+			_vals = _vals.cwiseProduct(_drop_masks);
+		}
+		else if (_drop_value > 0) {
+			_vals *= (1 - _drop_value);
+		}
+		if (_bTrain)
+			_losses.setZero(_dim, steps);
+	}
+
+	// turns _losses into the losses before dropout
+	inline void backwardDrop() {
+		if (_drop_value > 0)
+			_losses = _losses.cwiseProduct(_drop_masks);
+	}
+};
+
+/*
+ the context window of WindowBuilder: the step itself, then the left and then the right
+ context, zeros beyond the sentence. the inputs are per-step nodes or a sequence,
+ a context of 0 just gathers per-step nodes into a sequence.
+ */
+class WindowSeqNode : public MatSeqNode {
+public:
+	int _in_dim;
+	int _context;
+	int _window;
+	vector<PNode> _ins;
+	SeqNode* _in_seq;
+
+public:
+	WindowSeqNode() : MatSeqNode() {
+		_in_dim = _context = 0;
+		_window = 1;
+		_in_seq = NULL;
+	}
+
+	inline void init(int inDim, int context) {
+		_in_dim = inDim;
+		_context = context;
+		_window = 2 * context + 1;
+		MatSeqNode::init(_in_dim * _window, -1);
+	}
+
+	inline void forward(Graph* cg, const vector<PNode>& x) {
+		_ins = x;
+		_in_seq = NULL;
+		_bTrain = cg->train;
+		cg->addNode(this);
+	}
+
+	inline void forward(Graph* cg, SeqNode* x) {
+		_ins.clear();
+		_in_seq = x;
+		_bTrain = cg->train;
+		cg->addNode(this);
+	}
+
+	inline void compute() {
+		int steps = _in_seq != NULL ? _in_seq->steps() : _ins.size();
+		_vals.setZero(_dim, steps);
+		for (int step = 0; step < steps; step++) {
+			for (int offset = 0; offset < _window; offset++) {
+				int pos = position(step, offset);
+				if (pos < 0 || pos >= steps)
+					continue;
+				if (_in_seq != NULL)
+					_vals.col(step).segment(offset * _in_dim, _in_dim) = _in_seq->seqVal().col(pos);
+				else
+					_vals.col(step).segment(offset * _in_dim, _in_dim) = _ins[pos]->val.vec();
+			}
+		}
+		forwardDrop();
+	}
+
+	inline void backward() {
+		int steps = _vals.cols();
+		for (int step = 0; step < steps; step++) {
+			for (int offset = 0; offset < _window; offset++) {
+				int pos = position(step, offset);
+				if (pos < 0 || pos >= steps)
+					continue;
+				if (_in_seq != NULL)
+					_in_seq->seqLoss().col(pos) += _losses.col(step).segment(offset * _in_dim, _in_dim);
+				else
+					_ins[pos]->loss.vec() += _losses.col(step).segment(offset * _in_dim, _in_dim);
+			}
+		}
+	}
+
+private:
+	// sentence position feeding window block offset of step
+	inline int position(int step, int offset) const {
+		if (offset == 0)
+			return step;
+		if (offset <= _context)
+			return step - offset;
+		return step + offset - _context;
+	}
+};
+
+// the UniNode of every step at once: tanh(W * x + b), then dropout
+class UniSeqNode : public MatSeqNode {
+public:
+	UniParams* _param;
+	SeqNode* _in;
+	BatchMat _acts; // before dropout, training only
+
+public:
+	UniSeqNode() : MatSeqNode() {
+		_param = NULL;
+		_in = NULL;
+	}
+
+	inline void setParam(UniParams* paramInit) {
+		_param = paramInit;
+	}
+
+	inline void forward(Graph* cg, SeqNode* x) {
+		_in = x;
+		_bTrain = cg->train;
+		cg->addNode(this);
+	}
+
+	inline void compute() {
+		// decoding needs no copy before dropout, the values are computed in place
+		BatchMat& acts = _bTrain ? _acts : _vals;
+		acts.noalias() = _param->W.val.mat() * _in->seqVal();
+		if (_param->bUseB)
+			acts.colwise() += _param->b.val.mat().col(0);
+		batchTanh(acts);
+		if (_bTrain)
+			_vals = _acts;
+		forwardDrop();
+	}
+
+	inline void backward() {
+		backwardDrop();
+		BatchMat dpre = _losses.cwiseProduct((1 - _acts.array().square()).matrix());
+		_param->W.grad.mat().noalias() += dpre * _in->seqVal().transpose();
+		if (_param->bUseB)
+			_param->b.grad.mat().col(0) += dpre.rowwise().sum();
+		_in->seqLoss().noalias() += _param->W.val.mat().transpose() * dpre;
+	}
+};
+
+// the ConcatNode of every step at once: the rows of the first sequence, then of the second
+class ConcatSeqNode : public MatSeqNode {
+public:
+	SeqNode* _first;
+	SeqNode* _second;
+
+public:
+	ConcatSeqNode() : MatSeqNode() {
+		_first = _second = NULL;
+	}
+
+	inline void forward(Graph* cg, SeqNode* first, SeqNode* second) {
+		_first = first;
+		_second = second;
+		_bTrain = cg->train;
+		cg->addNode(this);
+	}
+
+	inline void compute() {
+		const BatchMat& first = _first->seqVal();
+		const BatchMat& second = _second->seqVal();
+		_vals.resize(_dim, first.cols());
+		_vals.topRows(first.rows()) = first;
+		_vals.bottomRows(second.rows()) = second;
+		forwardDrop();
+	}
+
+	inline void backward() {
+		backwardDrop();
+		_first->seqLoss() += _losses.topRows(_first->seqVal().rows());
+		_second->seqLoss() += _losses.bottomRows(_second->seqVal().rows());
+	}
+};
+
+/*
+ AvgPoolNode, MaxPoolNode and MinPoolNode over a sequence and the ConcatNode after them,
+ in a single pass over its columns: the value is avg, then max, then min, 3 * dim.
+ the steps the max and min were taken from are kept, so the backward routes their losses
+ without looking at the values again.
+ */
+class PoolingSeqNode : public Node {
+public:
+	int _in_dim;
+	SeqNode* _in;
+	vector<int> _max_steps;
+	vector<int> _min_steps;
+
+public:
+	PoolingSeqNode() : Node() {
+		_in_dim = 0;
+		_in = NULL;
+	}
+
+	// the dropout is that of the library nodes, on the 3 * dim values
+	inline void init(int inDim, dtype dropout, AlignedMemoryPool* mem = NULL, bool inference = false) {
+		_in_dim = inDim;
+		_max_steps.resize(_in_dim);
+		_min_steps.resize(_in_dim);
+		if (inference)
+			initValue(*this, 3 * _in_dim, dropout, mem);
+		else
+			Node::init(3 * _in_dim, dropout, mem);
+	}
+
+	inline void forward(Graph* cg, SeqNode* x) {
+		_in = x;
+		cg->addNode(this);
+	}
+
+	inline void compute() {
+		const BatchMat& x = _in->seqVal();
+		int steps = x.cols();
+		dtype* avg = val.v;
+		dtype* max = val.v + _in_dim;
+		dtype* min = val.v + 2 * _in_dim;
+		if (steps == 0) {
+			std::fill(val.v, val.v + 3 * _in_dim, 0);
+			return;
+		}
+		const dtype* col = x.data();
+		for (int idy = 0; idy < _in_dim; idy++) {
+			avg[idy] = max[idy] = min[idy] = col[idy];
+			_max_steps[idy] = _min_steps[idy] = 0;
+		}
+		for (int step = 1; step < steps; step++) {
+			col = x.data() + step * _in_dim;
+			for (int idy = 0; idy < _in_dim; idy++) {
+				dtype value = col[idy];
+				avg[idy] += value;
+				if (value > max[idy]) {
+					max[idy] = value;
+					_max_steps[idy] = step;
+				}
+				if (value < min[idy]) {
+					min[idy] = value;
+					_min_steps[idy] = step;
+				}
+			}
+		}
+		for (int idy = 0; idy < _in_dim; idy++)
+			avg[idy] /= steps;
+	}
+
+	inline void backward() {
+		BatchMat& x_loss = _in->seqLoss();
+		int steps = x_loss.cols();
+		if (steps == 0)
+			return;
+		for (int step = 0; step < steps; step++) {
+			dtype* col = x_loss.data() + step * _in_dim;
+			for (int idy = 0; idy < _in_dim; idy++)
+				col[idy] += loss.v[idy] / steps;
+		}
+		for (int idy = 0; idy < _in_dim; idy++) {
+			x_loss(idy, _max_steps[idy]) += loss.v[_in_dim + idy];
+			x_loss(idy, _min_steps[idy]) += loss.v[2 * _in_dim + idy];
+		}
+	}
+};
+
+// one step of a sequence as a node of its own, for the per-step nodes of the library
+class SeqStepNode : public Node {
+public:
+	SeqNode* _in;
+	int _step;
+
+public:
+	SeqStepNode() : Node() {
+		_in = NULL;
+		_step = 0;
+	}
+
+	inline void forward(Graph* cg, SeqNode* in, int step) {
+		_in = in;
+		_step = step;
+		cg->addNode(this);
+	}
+
+	inline void compute() {
+		val.vec() = _in->seqVal().col(_step);
+	}
+
+	inline void backward() {
+		_in->seqLoss().col(_step) += loss.vec();
+	}
+};
+
+// the steps of a sequence as SeqStepNodes
+inline void forwardSteps(Graph* cg, SeqNode* in, vector<SeqStepNode>& steps, int num) {
+	for (int idx = 0; idx < num; idx++)
+		steps[idx].forward(cg, in, idx);
+}
+
+#endif /*_SEQUENCE_NODES_H_*/
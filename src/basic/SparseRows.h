@@ -0,0 +1,84 @@
+#ifndef _SPARSE_ROWS_H_
+#define _SPARSE_ROWS_H_
+
+#include "N3L.h"
+
+using namespace std;
+
+/*
+ the embedding gradients of a data-parallel worker whose table shares the values of the master.
+ only the rows the worker touches get a gradient: each gets a slot of _grads on its first loss,
+ so a replica holds touched rows * dim gradients instead of vocabulary * dim gradients and optimizer state.
+ GradientReplica::accumulate adds the slots into the master rows and clears them.
+ */
+class SparseRows {
+public:
+	SparseRows() {
+		_dim = 0;
+	}
+
+public:
+	void initial(int dim, int vocab) {
+		_dim = dim;
+		_slots.assign(vocab, -1);
+		_rows.clear();
+		_grads.clear();
+	}
+
+	// only the rows of a replica table are active, the graphs of the master write into E.grad
+	bool active() const {
+		return _dim > 0;
+	}
+
+	int size() const {
+		return _rows.size();
+	}
+
+	int row(int slot) const {
+		return _rows[slot];
+	}
+
+	const dtype* grad(int slot) const {
+		return _grads.data() + slot * _dim;
+	}
+
+	void add(int index, const dtype* loss) {
+		int slot = _slots[index];
+		if (slot < 0) {
+			slot = _slots[index] = _rows.size();
+			_rows.push_back(index);
+			_grads.resize(_grads.size() + _dim, 0);
+		}
+		dtype* grad = _grads.data() + slot * _dim;
+		for (int idx = 0; idx < _dim; idx++)
+			grad[idx] += loss[idx];
+	}
+
+	// keeps the capacity of the rows seen so far
+	void clear() {
+		for (int slot = 0; slot < _rows.size(); slot++)
+			_slots[_rows[slot]] = -1;
+		_rows.clear();
+		_grads.clear();
+	}
+
+private:
+	int _dim;
+	vector<int> _slots; // slot of every row of the table, -1 if untouched
+	vector<int> _rows; // row of every slot
+	vector<dtype> _grads; // _dim values per slot
+};
+
+// the fields and shape of the master table without buffers of its own, for initialReplica
+inline void replicaTable(LookupTable& table, const LookupTable& master) {
+	table.elems = master.elems;
+	table.nDim = master.nDim;
+	table.nVSize = master.nVSize;
+	table.nUNKId = master.nUNKId;
+	table.bFineTune = master.bFineTune;
+	table.E.val.row = master.E.val.row;
+	table.E.val.col = master.E.val.col;
+	table.E.val.size = master.E.val.size;
+}
+
+#endif /*_SPARSE_ROWS_H_*/
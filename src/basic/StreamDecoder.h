@@ -0,0 +1,153 @@
+#ifndef _STREAM_DECODER_H_
+#define _STREAM_DECODER_H_
+
+#include <map>
+#include <deque>
+#include "N3L.h"
+#include "Instance.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+/*
+ decodes a corpus of any size in bounded memory.
+ a reader thread cuts the instances into blocks, every worker decodes whole blocks,
+ and a writer thread puts the blocks out in the order they were read.
+ the blocks are recycled: at most 2 * workers + 2 of them are read and not yet written
+ at any time, so the memory does not grow with the corpus and the output starts as
+ soon as the first block is decoded.
+ */
+class StreamDecoder {
+public:
+	// the next instance, false at the end of the corpus
+	typedef function<bool(Instance&)> ReadFunc;
+	// the labels of a block on the graph of a worker
+	typedef function<void(int, const vector<Instance>&, vector<string>&)> DecodeFunc;
+	// a decoded block, in the order of the corpus
+	typedef function<void(vector<Instance>&, const vector<string>&)> WriteFunc;
+
+	StreamDecoder(int workers = 1, int blockSize = 256) {
+		_workers = workers < 1 ? 1 : workers;
+		_block_size = blockSize < 1 ? 1 : blockSize;
+	}
+
+public:
+	// returns the number of instances
+	int run(const ReadFunc& read, const DecodeFunc& decode, const WriteFunc& write) {
+		int block_num = 2 * _workers + 2;
+		_blocks.clear();
+		_blocks.resize(block_num);
+		_free.clear();
+		for (int idx = 0; idx < block_num; idx++)
+			_free.push_back(&_blocks[idx]);
+		_read.clear();
+		_decoded.clear();
+		_read_blocks = 0;
+		_read_done = false;
+
+		int instance_num = 0;
+		thread reader([&]() {
+			while (true) {
+				Block* block = take(_free);
+				block->insts.resize(_block_size);
+				int count = 0;
+				while (count < _block_size && read(block->insts[count]))
+					count++;
+				block->insts.resize(count);
+				instance_num += count;
+				unique_lock<mutex> lock(_mutex);
+				if (count == 0) {
+					_free.push_back(block);
+					_read_done = true;
+					_cond.notify_all();
+					return;
+				}
+				block->seq = _read_blocks++;
+				_read.push_back(block);
+				_cond.notify_all();
+				if (count < _block_size) {
+					_read_done = true;
+					return;
+				}
+			}
+		});
+
+		thread writer([&]() {
+			for (int seq = 0; ; seq++) {
+				Block* block = NULL;
+				{
+					unique_lock<mutex> lock(_mutex);
+					_cond.wait(lock, [&]() { return _decoded.count(seq) > 0 || (_read_done && seq == _read_blocks); });
+					if (_decoded.count(seq) == 0)
+						return;
+					block = _decoded[seq];
+					_decoded.erase(seq);
+				}
+				write(block->insts, block->labels);
+				give(_free, block);
+			}
+		});
+
+		ThreadPool pool;
+		if (_workers > 1)
+			pool.start(_workers);
+		pool.run(_workers, [&](int worker) {
+			while (true) {
+				Block* block = NULL;
+				{
+					unique_lock<mutex> lock(_mutex);
+					_cond.wait(lock, [&]() { return !_read.empty() || _read_done; });
+					if (_read.empty())
+						return;
+					block = _read.front();
+					_read.pop_front();
+				}
+				block->labels.clear();
+				decode(worker, block->insts, block->labels);
+				block->labels.resize(block->insts.size());
+				unique_lock<mutex> lock(_mutex);
+				_decoded[block->seq] = block;
+				_cond.notify_all();
+			}
+		});
+
+		reader.join();
+		writer.join();
+		return instance_num;
+	}
+
+private:
+	struct Block {
+		int seq;
+		vector<Instance> insts;
+		vector<string> labels;
+	};
+
+	Block* take(deque<Block*>& queue) {
+		unique_lock<mutex> lock(_mutex);
+		_cond.wait(lock, [&]() { return !queue.empty(); });
+		Block* block = queue.front();
+		queue.pop_front();
+		return block;
+	}
+
+	void give(deque<Block*>& queue, Block* block) {
+		unique_lock<mutex> lock(_mutex);
+		queue.push_back(block);
+		_cond.notify_all();
+	}
+
+private:
+	int _workers;
+	int _block_size;
+	vector<Block> _blocks;
+	deque<Block*> _free;  // blocks the reader may fill
+	deque<Block*> _read;  // blocks waiting for a worker
+	map<int, Block*> _decoded;  // blocks waiting for the writer, by their order in the corpus
+	int _read_blocks;
+	bool _read_done;
+	mutex _mutex;
+	condition_variable _cond;
+};
+
+#endif /*_STREAM_DECODER_H_*/
@@ -0,0 +1,112 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+using namespace std;
+
+/*
+ a fixed set of worker threads consuming one shared task queue.
+ without started threads every task runs inline on the calling thread.
+ */
+class ThreadPool {
+public:
+	ThreadPool() {
+		m_bStop = false;
+	}
+
+	~ThreadPool() {
+		stop();
+	}
+
+	// a pool already running nThreads keeps them
+	void start(int nThreads) {
+		if (nThreads == m_workers.size())
+			return;
+		stop();
+		m_bStop = false;
+		for (int idx = 0; idx < nThreads; idx++) {
+			m_workers.push_back(thread(&ThreadPool::work, this));
+		}
+	}
+
+	void stop() {
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_bStop = true;
+		}
+		m_condition.notify_all();
+		for (int idx = 0; idx < m_workers.size(); idx++) {
+			if (m_workers[idx].joinable())
+				m_workers[idx].join();
+		}
+		m_workers.clear();
+	}
+
+	int size() const {
+		return m_workers.size();
+	}
+
+	future<void> push(const function<void()>& task) {
+		shared_ptr<packaged_task<void()> > pTask(new packaged_task<void()>(task));
+		future<void> result = pTask->get_future();
+		if (m_workers.empty()) {
+			(*pTask)();
+			return result;
+		}
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_tasks.push([pTask]() { (*pTask)(); });
+		}
+		m_condition.notify_one();
+		return result;
+	}
+
+	// calls func(0), ..., func(count - 1) and returns when all of them are done
+	void run(int count, const function<void(int)>& func) {
+		if (count == 1 || m_workers.empty()) {
+			for (int idx = 0; idx < count; idx++)
+				func(idx);
+			return;
+		}
+		vector<future<void> > results;
+		for (int idx = 0; idx < count; idx++) {
+			results.push_back(push(bind(func, idx)));
+		}
+		for (int idx = 0; idx < count; idx++) {
+			results[idx].get();
+		}
+	}
+
+private:
+	void work() {
+		while (true) {
+			function<void()> task;
+			{
+				unique_lock<mutex> lock(m_mutex);
+				m_condition.wait(lock, [this]() { return m_bStop || !m_tasks.empty(); });
+				if (m_bStop && m_tasks.empty())
+					return;
+				task = m_tasks.front();
+				m_tasks.pop();
+			}
+			task();
+		}
+	}
+
+private:
+	vector<thread> m_workers;
+	queue<function<void()> > m_tasks;
+	mutex m_mutex;
+	condition_variable m_condition;
+	bool m_bStop;
+};
+
+#endif /*_THREAD_POOL_H_*/
@@ -13,7 +13,12 @@
 #define _UTILITY_UTF_H
 
 #include <string>
+#include <vector>
+#include <cstring>
 #include <cassert>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /*===============================================================
  *
@@ -240,35 +245,114 @@ inline std::string wordtype(const std::string &s) {
   return type;
 }
 
-inline std::string normalize_to_lowerwithdigit(const std::string& s)
-{
-  std::vector<string> chars;
-  getCharactersFromUTF8String(s, chars);
-  std::string lowcase = "";
-  for (int i = 0; i < chars.size(); i++) {
-    if (chars[i].length() > 1) {
-      lowcase = lowcase + chars[i];
-    } else if (isdigit(chars[i][0])) {
-      lowcase = lowcase + "0";
-    } else if (isalpha(chars[i][0])) {
-      if (islower(chars[i][0]))
-      {
-        lowcase = lowcase + chars[i][0];
-      }
-      else
-      {
-        char temp = chars[i][0] + 'a'-'A';
-        lowcase = lowcase + temp;
-      }
+/*----------------------------------------------------------------
+ *
+ * getUTF8CharLength - the bytes of the character at idx, with
+ *                     the boundaries of getCharactersFromUTF8String
+ *
+ *----------------------------------------------------------------*/
+
+inline int getUTF8CharLength(const char *s, int idx, int size) {
+  unsigned char c = s[idx];
+  int len = 4;
+  if ((c & 0x80) == 0)
+    len = 1;
+  else if ((c & 0xE0) == 0xC0)
+    len = 2;
+  else if ((c & 0xF0) == 0xE0)
+    len = 3;
+  return len < size - idx ? len : size - idx;
+}
+
+#if defined(__SSE2__)
+// whether the 16 bytes at s are all ascii
+inline bool isASCIIBlock(const char *s) {
+  return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)s)) == 0;
+}
+#endif
+
+/*----------------------------------------------------------------
+ *
+ * getUTF8CharOffsets - the offsets of the characters of s, 
+ *                      followed by size. Returns the number
+ *                      of characters.
+ *
+ *----------------------------------------------------------------*/
+
+inline int getUTF8CharOffsets(const char *s, int size, std::vector<int>& offsets) {
+  offsets.clear();
+  int idx = 0;
+  while (idx < size) {
+#if defined(__SSE2__)
+    // every byte of an ascii run is a character
+    while (idx + 16 <= size && isASCIIBlock(s + idx)) {
+      for (int end = idx + 16; idx < end; ++idx)
+        offsets.push_back(idx);
     }
-    else
-    {
-      lowcase = lowcase + chars[i];
+    if (idx >= size)
+      break;
+#endif
+    offsets.push_back(idx);
+    idx += getUTF8CharLength(s, idx, size);
+  }
+  offsets.push_back(size);
+  return offsets.size() - 1;
+}
+
+/*----------------------------------------------------------------
+ *
+ * normalizeUTF8LowerWithDigit - writes s into out, which holds
+ *                               size bytes, with ascii digits
+ *                               as '0' and ascii letters in 
+ *                               lower case. Other characters are
+ *                               copied, so the length is kept.
+ *
+ *----------------------------------------------------------------*/
+
+inline void normalizeUTF8LowerWithDigit(const char *s, int size, char *out) {
+  int idx = 0;
+  while (idx < size) {
+#if defined(__SSE2__)
+    // 16 ascii characters at once, the signed compares are safe below 0x80
+    while (idx + 16 <= size && isASCIIBlock(s + idx)) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(s + idx));
+      __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+      __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+      v = _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8('a' - 'A')));
+      v = _mm_or_si128(_mm_andnot_si128(digit, v), _mm_and_si128(digit, _mm_set1_epi8('0')));
+      _mm_storeu_si128((__m128i*)(out + idx), v);
+      idx += 16;
     }
+    if (idx >= size)
+      break;
+#endif
+    int len = getUTF8CharLength(s, idx, size);
+    if (len > 1) {
+      memcpy(out + idx, s + idx, len);
+    } else if (s[idx] >= '0' && s[idx] <= '9') {
+      out[idx] = '0';
+    } else if (s[idx] >= 'A' && s[idx] <= 'Z') {
+      out[idx] = s[idx] + 'a' - 'A';
+    } else {
+      out[idx] = s[idx];
+    }
+    idx += len;
   }
-  return lowcase;
 }
 
+inline void normalize_to_lowerwithdigit(const std::string& s, std::string& out)
+{
+  out.resize(s.size());
+  if (!s.empty())
+    normalizeUTF8LowerWithDigit(s.data(), s.size(), &out[0]);
+}
+
+inline std::string normalize_to_lowerwithdigit(const std::string& s)
+{
+  std::string lowcase;
+  normalize_to_lowerwithdigit(s, lowcase);
+  return lowcase;
+}
 
 /*----------------------------------------------------------------
  *
@@ -0,0 +1,92 @@
+#ifndef _CHECK_H_
+#define _CHECK_H_
+
+#include <cstdio>
+#include "N3L.h"
+#include "SequenceNodes.h"
+
+using namespace std;
+
+/*
+ helpers of the check programs run by ctest.
+ a failed expectation is printed and counted, main returns the number of failures.
+ */
+static int check_failures = 0;
+
+// steps and tolerance of the finite differences, looser for float
+static const dtype check_eps = sizeof(dtype) == sizeof(float) ? 1e-2 : 1e-5;
+static const dtype check_tol = sizeof(dtype) == sizeof(float) ? 5e-2 : 1e-5;
+
+inline void expect(bool cond, const string& what) {
+	if (!cond) {
+		check_failures++;
+		std::cerr << "failed: " << what << std::endl;
+	}
+}
+
+// relative to the larger value once it is above 1
+inline bool near(dtype a, dtype b, dtype tol) {
+	dtype scale = std::max((dtype)1, std::max((dtype)fabs(a), (dtype)fabs(b)));
+	return fabs(a - b) <= tol * scale;
+}
+
+inline void expectNear(const dtype* a, const dtype* b, int size, dtype tol, const string& what) {
+	for (int idx = 0; idx < size; idx++) {
+		if (!near(a[idx], b[idx], tol)) {
+			check_failures++;
+			std::cerr << "failed: " << what << " at " << idx << ": " << a[idx] << " vs " << b[idx] << std::endl;
+			return;
+		}
+	}
+}
+
+// central differences of loss() over every entry of value, against the analytic gradient grad
+template<typename LossFunc>
+inline void checkGradient(dtype* value, const dtype* grad, int size, LossFunc loss, const string& what) {
+	vector<dtype> numeric(size);
+	for (int idx = 0; idx < size; idx++) {
+		dtype orig = value[idx];
+		value[idx] = orig + check_eps;
+		dtype plus = loss();
+		value[idx] = orig - check_eps;
+		dtype minus = loss();
+		value[idx] = orig;
+		numeric[idx] = (plus - minus) / (2 * check_eps);
+	}
+	expectNear(grad, numeric.data(), size, check_tol, what);
+}
+
+// an input sequence, its values and losses are set by the checks
+class FixedSeqNode : public MatSeqNode {
+public:
+	inline void compute() {
+	}
+
+	inline void backward() {
+	}
+};
+
+inline void randomMat(BatchMat& mat, int rows, int cols) {
+	mat = BatchMat::Random(rows, cols);
+}
+
+inline void addWeights(BiParams& param, vector<Param*>& weights) {
+	weights.push_back(&param.W1);
+	weights.push_back(&param.W2);
+	weights.push_back(&param.b);
+}
+
+inline void zeroGrads(const vector<Param*>& weights) {
+	for (int idx = 0; idx < weights.size(); idx++)
+		weights[idx]->grad.mat().setZero();
+}
+
+inline int checkResult(const string& name) {
+	if (check_failures == 0)
+		std::cout << name << ": all checks passed" << std::endl;
+	else
+		std::cout << name << ": " << check_failures << " checks failed" << std::endl;
+	return check_failures;
+}
+
+#endif /*_CHECK_H_*/
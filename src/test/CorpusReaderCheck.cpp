@@ -0,0 +1,129 @@
+/*
+ * CorpusReaderCheck.cpp
+ *
+ * the instances of CorpusReader, split over one or several threads or streamed by next(),
+ * against the lines they were written from: tab and space runs, '\r\n' endings, lines
+ * without words, maxInstance and the end of the corpus at the first empty line.
+ */
+
+#include "Check.h"
+#include "Instance.h"
+#include "CorpusReader.h"
+
+using namespace std;
+
+static const string corpus_file = "CorpusReaderCheck.txt";
+
+inline string instanceText(const Instance& inst) {
+	string text = inst.m_label + "|";
+	for (int idx = 0; idx < inst.size(); idx++)
+		text += " " + inst.m_tweet[idx];
+	return text;
+}
+
+inline void expectInstances(const vector<Instance>& insts, const vector<string>& expected, int count, const string& what) {
+	expect(insts.size() == count, what + " count " + to_string(insts.size()));
+	for (int idx = 0; idx < insts.size() && idx < count; idx++)
+		expect(instanceText(insts[idx]) == expected[idx], what + " instance " + to_string(idx) + ": " + instanceText(insts[idx]));
+}
+
+// the file, and what each instance must read as
+void writeCorpus(bool finalNewline, vector<string>& expected) {
+	ofstream os(corpus_file.c_str(), ios::binary);
+	expected.clear();
+	for (int line = 0; line < 60; line++) {
+		string label = "L" + to_string(line % 4);
+		switch (line % 6) {
+		case 0:
+			os << label << "\tw" << line << " x y\n";
+			expected.push_back(label + "| w" + to_string(line) + " x y");
+			break;
+		case 1:
+			os << label << "\t\t  w" << line << "   x  \n";
+			expected.push_back(label + "| w" + to_string(line) + " x");
+			break;
+		case 2:
+			os << label << "\tw" << line << " x\r\n";
+			expected.push_back(label + "| w" + to_string(line) + " x");
+			break;
+		case 3:
+			os << label << "\n";
+			expected.push_back(label + "|");
+			break;
+		case 4:
+			os << "\t" << label << "\tw" << line << "\tignored\n";
+			expected.push_back(label + "| w" + to_string(line));
+			break;
+		default:
+			os << label << "\tw" << line << (line == 59 && !finalNewline ? "" : "\n");
+			expected.push_back(label + "| w" + to_string(line));
+		}
+	}
+	os.close();
+}
+
+void checkCorpus(bool finalNewline) {
+	vector<string> expected;
+	writeCorpus(finalNewline, expected);
+	string name = finalNewline ? "corpus" : "corpus without final newline";
+	for (int threads = 1; threads <= 7; threads += 2) {
+		CorpusReader reader(threads);
+		vector<Instance> insts;
+		expect(reader.readInstances(corpus_file, insts), name + " read");
+		expectInstances(insts, expected, expected.size(), name + " with " + to_string(threads) + " threads");
+		expect(reader.readInstances(corpus_file, insts, 25), name + " read 25");
+		expectInstances(insts, expected, 25, name + " maxInstance with " + to_string(threads) + " threads");
+	}
+
+	CorpusReader reader;
+	vector<Instance> insts;
+	Instance inst;
+	expect(reader.open(corpus_file), name + " open");
+	while (reader.next(inst))
+		insts.push_back(inst);
+	reader.close();
+	expectInstances(insts, expected, expected.size(), name + " streamed");
+}
+
+// nothing after the first empty line is read
+void checkEmptyLine() {
+	ofstream os(corpus_file.c_str(), ios::binary);
+	for (int line = 0; line < 30; line++)
+		os << "L\tw" << line << "\n";
+	os << "\r\n";
+	for (int line = 30; line < 60; line++)
+		os << "L\tw" << line << "\n";
+	os.close();
+	vector<string> expected;
+	for (int line = 0; line < 30; line++)
+		expected.push_back("L| w" + to_string(line));
+
+	for (int threads = 1; threads <= 7; threads += 2) {
+		CorpusReader reader(threads);
+		vector<Instance> insts;
+		reader.readInstances(corpus_file, insts);
+		expectInstances(insts, expected, expected.size(), "empty line with " + to_string(threads) + " threads");
+	}
+
+	CorpusReader reader;
+	vector<Instance> insts;
+	Instance inst;
+	reader.open(corpus_file);
+	while (reader.next(inst))
+		insts.push_back(inst);
+	expectInstances(insts, expected, expected.size(), "empty line streamed");
+}
+
+int main(int argc, char* argv[]) {
+	checkCorpus(true);
+	checkCorpus(false);
+	checkEmptyLine();
+
+	CorpusReader reader(3);
+	vector<Instance> insts;
+	expect(!reader.readInstances("CorpusReaderCheck.missing", insts), "a missing corpus");
+	expect(!reader.open("CorpusReaderCheck.missing"), "a missing corpus streamed");
+
+	remove(corpus_file.c_str());
+	return checkResult("CorpusReaderCheck");
+}
@@ -0,0 +1,220 @@
+/*
+ * GradientCheck.cpp
+ *
+ * finite difference checks of the batch recurrent layers of BatchRecurrent.h
+ * and of the sequence nodes of SequenceNodes.h, without dropout.
+ * the loss is the sum of the outputs weighted by a fixed random matrix.
+ */
+
+#include "Check.h"
+
+using namespace std;
+
+// a padded batch of three sequences, one of them full length
+template<typename Layer, typename Params>
+void checkBatchLayer(Params& params, const vector<Param*>& weights, bool left2right, const string& name) {
+	const int inDim = 3, outDim = 4, steps = 3;
+	vector<int> lengths;
+	lengths.push_back(3);
+	lengths.push_back(1);
+	lengths.push_back(2);
+	int cols = steps * lengths.size();
+
+	Layer layer;
+	layer.init(&params, -1, left2right);
+	BatchMat x, weight;
+	randomMat(x, inDim, cols);
+	randomMat(weight, outDim, cols);
+
+	zeroGrads(weights);
+	layer.forward(x, lengths, steps, true);
+	layer._hiddens_loss = weight;
+	BatchMat x_loss = BatchMat::Zero(inDim, cols);
+	layer.backward(x, x_loss);
+
+	auto loss = [&]() {
+		layer.forward(x, lengths, steps, false);
+		return (dtype)layer._hiddens.cwiseProduct(weight).sum();
+	};
+	string dir = left2right ? " left2right" : " right2left";
+	for (int idx = 0; idx < weights.size(); idx++) {
+		Tensor2D& val = weights[idx]->val;
+		checkGradient(val.v, weights[idx]->grad.v, val.size, loss, name + dir + " weight " + to_string(idx));
+	}
+	checkGradient(x.data(), x_loss.data(), x.size(), loss, name + dir + " input");
+
+	// padded steps neither read their input nor change the state
+	for (int step = 0; step < steps; step++) {
+		for (int idx = 0; idx < lengths.size(); idx++) {
+			int col = step * lengths.size() + idx;
+			if (step >= lengths[idx])
+				expect(x_loss.col(col).isZero(), name + dir + " padded input loss");
+		}
+	}
+}
+
+void checkBatchLayers() {
+	for (int dir = 0; dir < 2; dir++) {
+		RNNParams rnn;
+		rnn.initial(4, 3);
+		vector<Param*> rnn_weights;
+		addWeights(rnn._rnn, rnn_weights);
+		checkBatchLayer<BatchRNN>(rnn, rnn_weights, dir == 0, "BatchRNN");
+
+		GRNNParams grnn;
+		grnn.initial(4, 3);
+		vector<Param*> grnn_weights;
+		addWeights(grnn._rnn_update, grnn_weights);
+		addWeights(grnn._rnn_reset, grnn_weights);
+		addWeights(grnn._rnn, grnn_weights);
+		checkBatchLayer<BatchGRNN>(grnn, grnn_weights, dir == 0, "BatchGRNN");
+
+		LSTMParams lstm;
+		lstm.initial(4, 3);
+		vector<Param*> lstm_weights;
+		addWeights(lstm.input, lstm_weights);
+		addWeights(lstm.output, lstm_weights);
+		addWeights(lstm.forget, lstm_weights);
+		addWeights(lstm.cell, lstm_weights);
+		checkBatchLayer<BatchLSTM>(lstm, lstm_weights, dir == 0, "BatchLSTM");
+	}
+}
+
+// the step itself, then the left and then the right context, zeros beyond the sentence
+void checkWindow() {
+	const int dim = 2, steps = 4, context = 1;
+	FixedSeqNode in;
+	in.init(dim, -1);
+	in._vals.resize(dim, steps);
+	for (int step = 0; step < steps; step++)
+		for (int idx = 0; idx < dim; idx++)
+			in._vals(idx, step) = 10 * step + idx + 1;
+
+	WindowSeqNode window;
+	window.init(dim, context);
+	window._in_seq = &in;
+	window._bTrain = true;
+	window.compute();
+	expect(window._vals.rows() == 3 * dim && window._vals.cols() == steps, "window shape");
+	for (int step = 0; step < steps; step++) {
+		expect(window._vals.col(step).segment(0, dim) == in._vals.col(step), "window center");
+		if (step > 0)
+			expect(window._vals.col(step).segment(dim, dim) == in._vals.col(step - 1), "window left");
+		else
+			expect(window._vals.col(step).segment(dim, dim).isZero(), "window left border");
+		if (step + 1 < steps)
+			expect(window._vals.col(step).segment(2 * dim, dim) == in._vals.col(step + 1), "window right");
+		else
+			expect(window._vals.col(step).segment(2 * dim, dim).isZero(), "window right border");
+	}
+
+	// the per-step inputs give the same window
+	vector<Node> nodes(steps);
+	vector<PNode> ins;
+	for (int step = 0; step < steps; step++) {
+		nodes[step].init(dim, -1);
+		nodes[step].val.vec() = in._vals.col(step);
+		ins.push_back(&nodes[step]);
+	}
+	WindowSeqNode step_window;
+	step_window.init(dim, context);
+	step_window._ins = ins;
+	step_window._bTrain = true;
+	step_window.compute();
+	expect(step_window._vals == window._vals, "window of per-step inputs");
+
+	// the window is linear, so its backward is the transpose: <W x, l> = <x, W^T l>
+	BatchMat weight;
+	randomMat(weight, 3 * dim, steps);
+	window._losses = weight;
+	in._losses.setZero(dim, steps);
+	window.backward();
+	dtype forward = window._vals.cwiseProduct(weight).sum();
+	dtype backward = in._vals.cwiseProduct(in._losses).sum();
+	expect(near(forward, backward, check_tol), "window backward is the transpose of forward");
+}
+
+void checkUni() {
+	const int inDim = 6, outDim = 4, steps = 5;
+	UniParams param;
+	param.initial(outDim, inDim, true);
+	param.W.grad.mat().setZero();
+	param.b.grad.mat().setZero();
+
+	FixedSeqNode in;
+	in.init(inDim, -1);
+	randomMat(in._vals, inDim, steps);
+	in._losses.setZero(inDim, steps);
+
+	UniSeqNode uni;
+	uni.init(outDim, -1);
+	uni.setParam(&param);
+	uni._in = &in;
+	uni._bTrain = true;
+	uni.compute();
+	BatchMat weight;
+	randomMat(weight, outDim, steps);
+	uni._losses = weight;
+	uni.backward();
+
+	// decoding computes in place and must give the same values
+	BatchMat train_vals = uni._vals;
+	auto loss = [&]() {
+		uni._bTrain = false;
+		uni.compute();
+		return (dtype)uni._vals.cwiseProduct(weight).sum();
+	};
+	loss();
+	expectNear(uni._vals.data(), train_vals.data(), train_vals.size(), check_tol, "UniSeqNode decode values");
+	checkGradient(param.W.val.v, param.W.grad.v, param.W.val.size, loss, "UniSeqNode W");
+	checkGradient(param.b.val.v, param.b.grad.v, param.b.val.size, loss, "UniSeqNode b");
+	checkGradient(in._vals.data(), in._losses.data(), in._vals.size(), loss, "UniSeqNode input");
+}
+
+// avg, then max, then min
+void checkPooling() {
+	const int dim = 4, steps = 5;
+	FixedSeqNode in;
+	in.init(dim, -1);
+	randomMat(in._vals, dim, steps);
+	in._losses.setZero(dim, steps);
+
+	PoolingSeqNode pool;
+	pool.init(dim, -1);
+	pool._in = &in;
+	pool.compute();
+	for (int idx = 0; idx < dim; idx++) {
+		expect(near(pool.val.v[idx], in._vals.row(idx).mean(), check_tol), "pooling avg");
+		expect(pool.val.v[dim + idx] == in._vals.row(idx).maxCoeff(), "pooling max");
+		expect(pool.val.v[2 * dim + idx] == in._vals.row(idx).minCoeff(), "pooling min");
+	}
+
+	BatchMat weight;
+	randomMat(weight, 3 * dim, 1);
+	for (int idx = 0; idx < 3 * dim; idx++)
+		pool.loss.v[idx] = weight(idx, 0);
+	pool.backward();
+	auto loss = [&]() {
+		pool.compute();
+		dtype sum = 0;
+		for (int idx = 0; idx < 3 * dim; idx++)
+			sum += pool.val.v[idx] * weight(idx, 0);
+		return sum;
+	};
+	checkGradient(in._vals.data(), in._losses.data(), in._vals.size(), loss, "PoolingSeqNode input");
+
+	// an empty sentence pools to zeros
+	in._vals.resize(dim, 0);
+	pool.compute();
+	for (int idx = 0; idx < 3 * dim; idx++)
+		expect(pool.val.v[idx] == 0, "pooling of an empty sequence");
+}
+
+int main(int argc, char* argv[]) {
+	srand(0);
+	checkBatchLayers();
+	checkWindow();
+	checkUni();
+	checkPooling();
+	return checkResult("GradientCheck");
+}
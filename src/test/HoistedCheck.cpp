@@ -0,0 +1,145 @@
+/*
+ * HoistedCheck.cpp
+ *
+ * the hoisted builders of HoistedRecurrent.h against the library builders
+ * RNNBuilder, GRNNBuilder and LSTMBuilder on the same parameters, without dropout:
+ * both run through a Graph and must agree on the outputs, the parameter
+ * gradients and the input losses. the threaded bidirectional node must agree
+ * with the two hoisted directions run one after the other.
+ */
+
+#include "Check.h"
+#include "HoistedRecurrent.h"
+
+using namespace std;
+
+struct RunResult {
+	BatchMat vals;
+	BatchMat in_loss;
+	vector<BatchMat> grads;
+};
+
+inline void collectGrads(const vector<Param*>& weights, vector<BatchMat>& grads) {
+	grads.clear();
+	for (int idx = 0; idx < weights.size(); idx++)
+		grads.push_back(weights[idx]->grad.mat());
+}
+
+inline void expectSame(const BatchMat& a, const BatchMat& b, const string& what) {
+	expect(a.rows() == b.rows() && a.cols() == b.cols(), what + " shape");
+	if (a.rows() == b.rows() && a.cols() == b.cols())
+		expectNear(a.data(), b.data(), a.size(), check_tol, what);
+}
+
+inline void expectSame(const RunResult& a, const RunResult& b, const string& name) {
+	expectSame(a.vals, b.vals, name + " values");
+	expectSame(a.in_loss, b.in_loss, name + " input loss");
+	for (int idx = 0; idx < a.grads.size(); idx++)
+		expectSame(a.grads[idx], b.grads[idx], name + " weight " + to_string(idx));
+}
+
+// forward and backward of one builder through a graph, the output loss being weight
+template<class HBuilder, class Params>
+void runBuilder(Params& params, const vector<Param*>& weights, FixedSeqNode& in, const BatchMat& weight,
+	bool left2right, bool hoist, RunResult& result) {
+	int steps = in._vals.cols();
+	HBuilder builder;
+	builder.resize(steps);
+	builder.init(&params, -1, left2right, NULL, hoist);
+
+	zeroGrads(weights);
+	in._losses.setZero(in._vals.rows(), steps);
+	Graph cg;
+	cg.clearValue(true);
+	builder.forward(&cg, &in);
+	SeqNode* output = builder.output();
+	result.vals = output->seqVal();
+	output->seqLoss() = weight;
+	cg.backward();
+	result.in_loss = in._losses;
+	collectGrads(weights, result.grads);
+}
+
+template<class HBuilder, class Params>
+void checkBuilder(Params& params, const vector<Param*>& weights, const string& name) {
+	const int inDim = 3, outDim = 4, steps = 5;
+	FixedSeqNode in;
+	in.init(inDim, -1);
+	randomMat(in._vals, inDim, steps);
+	BatchMat weight;
+	randomMat(weight, outDim, steps);
+
+	for (int dir = 0; dir < 2; dir++) {
+		bool left2right = dir == 0;
+		RunResult library, hoisted;
+		runBuilder<HBuilder>(params, weights, in, weight, left2right, false, library);
+		runBuilder<HBuilder>(params, weights, in, weight, left2right, true, hoisted);
+		expectSame(library, hoisted, name + (left2right ? " left2right" : " right2left"));
+	}
+
+	// both directions on two threads, against the two of them one after the other
+	RunResult sequential, threaded;
+	BatchMat weights2;
+	randomMat(weights2, outDim, steps);
+	HBuilder left, right;
+	left.resize(steps);
+	right.resize(steps);
+	left.init(&params, -1, true);
+	right.init(&params, -1, false);
+	for (int run = 0; run < 2; run++) {
+		RunResult& result = run == 0 ? sequential : threaded;
+		ThreadPool pool;
+		BiRecurrentNode<HBuilder> bi;
+		bi.setParam(&left, &right, &pool);
+		if (run == 1)
+			pool.start(1);
+
+		zeroGrads(weights);
+		in._losses.setZero(inDim, steps);
+		Graph cg;
+		cg.clearValue(true);
+		if (run == 0) {
+			left.forward(&cg, &in);
+			right.forward(&cg, &in);
+		}
+		else {
+			bi.forward(&cg, &in);
+		}
+		left.output()->seqLoss() = weight;
+		right.output()->seqLoss() = weights2;
+		cg.backward();
+		result.vals.resize(2 * outDim, steps);
+		result.vals.topRows(outDim) = left.output()->seqVal();
+		result.vals.bottomRows(outDim) = right.output()->seqVal();
+		result.in_loss = in._losses;
+		collectGrads(weights, result.grads);
+	}
+	expectSame(sequential, threaded, name + " bidirectional");
+}
+
+int main(int argc, char* argv[]) {
+	srand(0);
+	RNNParams rnn;
+	rnn.initial(4, 3);
+	vector<Param*> rnn_weights;
+	addWeights(rnn._rnn, rnn_weights);
+	checkBuilder<HoistedRNNBuilder>(rnn, rnn_weights, "HoistedRNNBuilder");
+
+	GRNNParams grnn;
+	grnn.initial(4, 3);
+	vector<Param*> grnn_weights;
+	addWeights(grnn._rnn_update, grnn_weights);
+	addWeights(grnn._rnn_reset, grnn_weights);
+	addWeights(grnn._rnn, grnn_weights);
+	checkBuilder<HoistedGRNNBuilder>(grnn, grnn_weights, "HoistedGRNNBuilder");
+
+	LSTMParams lstm;
+	lstm.initial(4, 3);
+	vector<Param*> lstm_weights;
+	addWeights(lstm.input, lstm_weights);
+	addWeights(lstm.output, lstm_weights);
+	addWeights(lstm.forget, lstm_weights);
+	addWeights(lstm.cell, lstm_weights);
+	checkBuilder<HoistedLSTMBuilder>(lstm, lstm_weights, "HoistedLSTMBuilder");
+	return checkResult("HoistedCheck");
+}
@@ -0,0 +1,168 @@
+/*
+ * ModelFileCheck.cpp
+ *
+ * a model written by ModelWriter and read back by ModelReader: the scalars, alphabets
+ * and parameters must come back unchanged, the tensors pointing into the file instead
+ * of buffers of their own, and a file of another labeler must be refused.
+ */
+
+#include "Check.h"
+#include "ModelFile.h"
+
+using namespace std;
+
+static const string model_file = "ModelFileCheck.model";
+
+inline void expectSame(const Tensor2D& a, const Tensor2D& b, const string& what) {
+	expect(a.row == b.row && a.col == b.col, what + " shape");
+	if (a.row == b.row && a.col == b.col)
+		expectNear(a.v, b.v, a.row * a.col, 0, what);
+}
+
+inline void expectSame(const BiParams& a, const BiParams& b, const string& what) {
+	expect(a.bUseB == b.bUseB, what + " bUseB");
+	expectSame(a.W1.val, b.W1.val, what + " W1");
+	expectSame(a.W2.val, b.W2.val, what + " W2");
+	expectSame(a.b.val, b.b.val, what + " b");
+}
+
+int main(int argc, char* argv[]) {
+	srand(0);
+	Alphabet wordAlpha, labelAlpha;
+	wordAlpha.from_string(unknownkey);
+	wordAlpha.from_string("the");
+	wordAlpha.from_string("model");
+	labelAlpha.from_string("B");
+	labelAlpha.from_string("I");
+	labelAlpha.from_string("O");
+	LookupTable words;
+	words.initial(&wordAlpha, 5, true);
+	UniParams hidden;
+	hidden.initial(4, 3, true);
+	GRNNParams grnn;
+	grnn.initial(4, 3);
+	LSTMParams lstm;
+	lstm.initial(4, 3);
+	vector<int> ids;
+	ids.push_back(3);
+	ids.push_back(-1);
+
+	{
+		ModelWriter writer;
+		expect(writer.open(model_file, "ModelFileCheck"), "open for writing");
+		writer.write(7);
+		writer.write(true);
+		writer.write((dtype)0.25);
+		writer.write(string("name"));
+		writer.write(ids);
+		writer.write(wordAlpha);
+		writer.write(words);
+		writer.write(labelAlpha);
+		writer.write(hidden);
+		writer.write(grnn);
+		writer.write(lstm);
+		expect(writer.good(), "write");
+	}
+
+	{
+		ModelReader reader;
+		expect(!reader.open(model_file, "OtherLabeler"), "a model of another labeler is refused");
+		expect(!reader.open("ModelFileCheck.missing", "ModelFileCheck"), "a missing file is refused");
+	}
+
+	{
+		ModelReader reader;
+		expect(reader.open(model_file, "ModelFileCheck"), "open for reading");
+		int count;
+		bool flag;
+		dtype value;
+		string name;
+		vector<int> read_ids;
+		reader.read(count);
+		reader.read(flag);
+		reader.read(value);
+		reader.read(name);
+		reader.read(read_ids);
+		expect(count == 7 && flag && value == (dtype)0.25 && name == "name", "scalars");
+		expect(read_ids == ids, "ids");
+
+		Alphabet readWordAlpha, readLabelAlpha;
+		LookupTable readWords;
+		UniParams readHidden;
+		GRNNParams readGrnn;
+		LSTMParams readLstm;
+		reader.read(readWordAlpha);
+		reader.read(readWords, &readWordAlpha);
+		reader.read(readLabelAlpha);
+		reader.read(readHidden);
+		reader.read(readGrnn);
+		reader.read(readLstm);
+		expect(reader.good(), "read");
+
+		expect(readWordAlpha.size() == wordAlpha.size() && readWordAlpha.from_string("model") == wordAlpha.from_string("model"), "word alphabet");
+		expect(readWordAlpha.from_string("unseen") < 0, "a read alphabet is fixed");
+		expect(readLabelAlpha.size() == 3 && readLabelAlpha.from_id(2) == "O", "label alphabet");
+
+		expect(readWords.nDim == 5 && readWords.nVSize == 3 && readWords.bFineTune, "table fields");
+		expect(readWords.elems == &readWordAlpha, "table alphabet");
+		expect(readWords.nUNKId == readWordAlpha.from_string(unknownkey), "table unknown id");
+		expectSame(readWords.E.val, words.E.val, "table values");
+		expect(readHidden.bUseB, "uni bUseB");
+		expectSame(readHidden.W.val, hidden.W.val, "uni W");
+		expectSame(readHidden.b.val, hidden.b.val, "uni b");
+		expectSame(readGrnn._rnn_update, grnn._rnn_update, "grnn update");
+		expectSame(readGrnn._rnn_reset, grnn._rnn_reset, "grnn reset");
+		expectSame(readGrnn._rnn, grnn._rnn, "grnn");
+		expectSame(readLstm.input, lstm.input, "lstm input");
+		expectSame(readLstm.output, lstm.output, "lstm output");
+		expectSame(readLstm.forget, lstm.forget, "lstm forget");
+		expectSame(readLstm.cell, lstm.cell, "lstm cell");
+
+		// only the values are bound, nothing is allocated for training
+		expect(readWords.E.val.v != NULL && readWords.E.grad.v == NULL, "table gradients are not allocated");
+		expect(readHidden.W.grad.v == NULL && readGrnn._rnn.W1.grad.v == NULL, "layer gradients are not allocated");
+
+		// the file keeps the values until it is closed, the tensors then are empty again
+		reader.close();
+		expect(readWords.E.val.v == NULL && readWords.E.val.row == 0, "close unbinds the tensors");
+		expect(readLstm.cell.W1.val.v == NULL && readLstm.cell.W1.val.size == 0, "close unbinds the layers");
+	}
+
+	{
+		// a truncated file fails instead of reading past its end
+		ifstream is(model_file.c_str(), ios::binary);
+		string data((istreambuf_iterator<char>(is)), istreambuf_iterator<char>());
+		is.close();
+		ofstream os(model_file.c_str(), ios::binary);
+		os.write(data.data(), data.size() / 2);
+		os.close();
+		int count;
+		bool flag;
+		dtype value;
+		string name;
+		vector<int> read_ids;
+		Alphabet readWordAlpha, readLabelAlpha;
+		LookupTable readWords;
+		UniParams readHidden;
+		GRNNParams readGrnn;
+		LSTMParams readLstm;
+		// declared last, so it unbinds the tensors before they are destroyed
+		ModelReader reader;
+		expect(reader.open(model_file, "ModelFileCheck"), "open a truncated file");
+		reader.read(count);
+		reader.read(flag);
+		reader.read(value);
+		reader.read(name);
+		reader.read(read_ids);
+		reader.read(readWordAlpha);
+		reader.read(readWords, &readWordAlpha);
+		reader.read(readLabelAlpha);
+		reader.read(readHidden);
+		reader.read(readGrnn);
+		reader.read(readLstm);
+		expect(!reader.good(), "a truncated file is not good");
+	}
+
+	remove(model_file.c_str());
+	return checkResult("ModelFileCheck");
+}